@@ -17,28 +17,25 @@
 
 using namespace NextPVR::utilities;
 
+namespace
+{
+  int BytesPerSecond(size_t bytes, int milliseconds)
+  {
+    return static_cast<int>(bytes * 1000 / std::max(milliseconds, 1));
+  }
+}
+
 namespace NextPVR
 {
   int Request::DoRequest(std::string resource, std::string& response)
   {
     auto start = std::chrono::steady_clock::now();
-    std::unique_lock<std::mutex> lock(m_mutexRequest);
     // build request string, adding SID if requred
-    const std::string URL = kodi::tools::StringUtils::Format("%s%s&sid=%s", m_settings.m_urlBase, resource.c_str(), GetSID());
+    const std::string path = kodi::tools::StringUtils::Format("%s&sid=%s", resource.c_str(), GetSID().c_str());
 
-    // ask XBMC to read the URL for us
-    int resultCode = HTTP_NOTFOUND;
-    kodi::vfs::CFile stream;
-    if (stream.OpenFile(URL, ADDON_READ_NO_CACHE))
+    int resultCode = HttpGet(path, response);
+    if (resultCode == HTTP_OK)
     {
-      char buffer[1025] = {0};
-      int count;
-      while ((count=stream.Read(buffer, 1024)))
-      {
-        response.append(buffer, count);
-      }
-      stream.Close();
-      resultCode = HTTP_OK;
       if ((response.empty() || strstr(response.c_str(), "<rsp stat=\"ok\">") == nullptr) && resource.find("channel.stream.info") == std::string::npos)
       {
         kodi::Log(ADDON_LOG_ERROR, "DoRequest failed, response=%s", response.c_str());
@@ -50,7 +47,7 @@ namespace NextPVR
       }
     }
     int milliseconds = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
-    kodi::Log(ADDON_LOG_DEBUG, "DoRequest return %s %d %d %d", resource.c_str(), resultCode, response.length(), milliseconds);
+    kodi::Log(ADDON_LOG_DEBUG, "DoRequest return %s %d %d %d %d", resource.c_str(), resultCode, response.length(), milliseconds, BytesPerSecond(response.length(), milliseconds));
     return resultCode;
   }
 
@@ -66,67 +63,164 @@ namespace NextPVR
     auto start = std::chrono::steady_clock::now();
     // return is same on timeout or http return ie 404, 500.
     tinyxml2::XMLError retError = tinyxml2::XML_ERROR_FILE_NOT_FOUND;
-    std::unique_lock<std::mutex> lock(m_mutexRequest);
     // build request string, adding SID if requred
-    std::string URL;
+    std::string path;
+    if (!GetMethodPath(resource, path))
+      return tinyxml2::XML_ERROR_FILE_COULD_NOT_BE_OPENED;
 
-    if (IsActiveSID())
-      URL = kodi::tools::StringUtils::Format("%s/service?method=%s&sid=%s", m_settings.m_urlBase, resource.c_str(), GetSID());
-    else if (kodi::tools::StringUtils::StartsWith(resource, "session"))
-      URL = kodi::tools::StringUtils::Format("%s/service?method=%s", m_settings.m_urlBase, resource.c_str());
-    else
+    std::string response;
+    if (HttpGet(path, response, compressed) == HTTP_OK)
+    {
+      retError = doc.Parse(response.c_str());
+      if (retError == tinyxml2::XML_SUCCESS)
+        retError = CheckResponse(doc);
+    }
+    int milliseconds = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+    kodi::Log(ADDON_LOG_DEBUG, "DoMethodRequest %s %d %d %d %d", resource.c_str(), retError, response.length(), milliseconds, BytesPerSecond(response.length(), milliseconds));
+    return retError;
+  }
+
+  tinyxml2::XMLError Request::DoStreamingMethodRequest(std::string resource, const char* element, const ElementCallback& callback)
+  {
+    auto start = std::chrono::steady_clock::now();
+    tinyxml2::XMLError retError = tinyxml2::XML_ERROR_FILE_NOT_FOUND;
+    std::string path;
+    if (!GetMethodPath(resource, path))
       return tinyxml2::XML_ERROR_FILE_COULD_NOT_BE_OPENED;
 
-    if (!compressed)
-      URL += "|Accept-Encoding=identity";
+    // each complete <element> is parsed and handed over as soon as it has arrived, only
+    // a successful response is streamed, anything else is kept for the usual error handling
+    enum { Header, Streaming, Whole } state = Header;
+    const std::string openTag = std::string("<") + element;
+    const std::string closeTag = std::string("</") + element + ">";
+    std::string pending;
+    size_t length = 0;
+    int elements = 0;
 
-    // ask XBMC to read the URL for us
-    kodi::vfs::CFile stream;
-    std::string response;
-    if (stream.OpenFile(URL, ADDON_READ_NO_CACHE))
+    auto sink = [&](const char* data, size_t count)
     {
-      char buffer[1025]{ 0 };
-      int count;
-      while ((count = stream.Read(buffer, 1024)))
+      length += count;
+      pending.append(data, count);
+      if (state == Header)
       {
-        response.append(buffer, count);
+        const size_t root = pending.find("<rsp");
+        if (root == std::string::npos || pending.find('>', root) == std::string::npos)
+          return true;
+        const std::string rootTag = pending.substr(root, pending.find('>', root) - root);
+        state = rootTag.find("stat=\"ok\"") != std::string::npos ? Streaming : Whole;
       }
-      stream.Close();
-      retError = doc.Parse(response.c_str());
-      if (retError == tinyxml2::XML_SUCCESS)
+      if (state != Streaming)
+        return true;
+
+      size_t consumed = 0;
+      size_t begin;
+      while ((begin = pending.find(openTag, consumed)) != std::string::npos)
       {
-        const char* attrib = doc.RootElement()->Attribute("stat");
-        if ( attrib == nullptr || strcmp(attrib, "ok"))
+        const size_t next = begin + openTag.length();
+        if (next >= pending.length())
+          break;
+        if (pending[next] != '>' && !isspace(static_cast<unsigned char>(pending[next])))
         {
-          kodi::Log(ADDON_LOG_DEBUG, "DoMethodRequest bad return %s", attrib);
-          retError = tinyxml2::XML_NO_ATTRIBUTE;
-          if (!strcmp(attrib, "fail"))
-          {
-            const tinyxml2::XMLElement* err = doc.RootElement()->FirstChildElement("err");
-            if (err)
-            {
-              const char* code = err->Attribute("code");
-              if (code)
-              {
-                kodi::Log(ADDON_LOG_DEBUG, "DoMethodRequest error code %s", code);
-                if (atoi(code) == 8)
-                {
-                  ClearSID();
-                  retError = tinyxml2::XML_ERROR_FILE_COULD_NOT_BE_OPENED;
-                  g_pvrclient->ResetConnection();
-                }
-              }
-            }
-          }
+          // longer tag name with the same prefix
+          consumed = next;
+          continue;
         }
-        else
+        const size_t end = pending.find(closeTag, next);
+        if (end == std::string::npos)
+          break;
+        consumed = end + closeTag.length();
+
+        tinyxml2::XMLDocument doc;
+        retError = doc.Parse(pending.data() + begin, consumed - begin);
+        if (retError != tinyxml2::XML_SUCCESS)
+        {
+          kodi::Log(ADDON_LOG_ERROR, "DoStreamingMethodRequest parse error %d", retError);
+          return false;
+        }
+        elements++;
+        if (!callback(doc.RootElement()))
+          return false;
+      }
+      pending.erase(0, consumed);
+      return true;
+    };
+
+    if (HttpGet(path, sink) == HTTP_OK)
+    {
+      if (state == Streaming)
+      {
+        // whatever follows the last element must close the root, otherwise the listing was cut short
+        if (pending.find("</rsp>") != std::string::npos)
         {
+          retError = tinyxml2::XML_SUCCESS;
           RenewSID();
         }
+        else
+        {
+          kodi::Log(ADDON_LOG_ERROR, "DoStreamingMethodRequest %s ended without </rsp> after %d elements", resource.c_str(), elements);
+          retError = tinyxml2::XML_ERROR_FILE_READ_ERROR;
+        }
+      }
+      else
+      {
+        tinyxml2::XMLDocument doc;
+        retError = doc.Parse(pending.c_str());
+        if (retError == tinyxml2::XML_SUCCESS)
+          retError = CheckResponse(doc);
       }
     }
+    else if (retError == tinyxml2::XML_SUCCESS)
+    {
+      // transfer failed part way through
+      retError = tinyxml2::XML_ERROR_FILE_READ_ERROR;
+    }
     int milliseconds = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
-    kodi::Log(ADDON_LOG_DEBUG, "DoMethodRequest %s %d %d %d", resource.c_str(), retError, response.length(), milliseconds);
+    kodi::Log(ADDON_LOG_DEBUG, "DoStreamingMethodRequest %s %d %d %d %d %d", resource.c_str(), retError, length, elements, milliseconds, BytesPerSecond(length, milliseconds));
+    return retError;
+  }
+
+  bool Request::GetMethodPath(const std::string& resource, std::string& path)
+  {
+    if (IsActiveSID())
+      path = kodi::tools::StringUtils::Format("/service?method=%s&sid=%s", resource.c_str(), GetSID().c_str());
+    else if (kodi::tools::StringUtils::StartsWith(resource, "session"))
+      path = kodi::tools::StringUtils::Format("/service?method=%s", resource.c_str());
+    else
+      return false;
+    return true;
+  }
+
+  tinyxml2::XMLError Request::CheckResponse(tinyxml2::XMLDocument& doc)
+  {
+    tinyxml2::XMLError retError = tinyxml2::XML_SUCCESS;
+    const char* attrib = doc.RootElement()->Attribute("stat");
+    if ( attrib == nullptr || strcmp(attrib, "ok"))
+    {
+      kodi::Log(ADDON_LOG_DEBUG, "DoMethodRequest bad return %s", attrib);
+      retError = tinyxml2::XML_NO_ATTRIBUTE;
+      if (!strcmp(attrib, "fail"))
+      {
+        const tinyxml2::XMLElement* err = doc.RootElement()->FirstChildElement("err");
+        if (err)
+        {
+          const char* code = err->Attribute("code");
+          if (code)
+          {
+            kodi::Log(ADDON_LOG_DEBUG, "DoMethodRequest error code %s", code);
+            if (atoi(code) == 8)
+            {
+              ClearSID();
+              retError = tinyxml2::XML_ERROR_FILE_COULD_NOT_BE_OPENED;
+              g_pvrclient->ResetConnection();
+            }
+          }
+        }
+      }
+    }
+    else
+    {
+      RenewSID();
+    }
     return retError;
   }
 
@@ -148,42 +242,120 @@ namespace NextPVR
 
   int Request::FileCopy(const char* resource, std::string fileName)
   {
-    std::unique_lock<std::mutex> lock(m_mutexRequest);
     ssize_t written = 0;
-    m_start = time(nullptr);
-
+    auto start = std::chrono::steady_clock::now();
 
     char separator = (strchr(resource, '?') == nullptr) ? '?' : '&';
-    const std::string URL = kodi::tools::StringUtils::Format("%s%s%csid=%s", m_settings.m_urlBase, resource, separator, GetSID());
+    const std::string path = kodi::tools::StringUtils::Format("%s%csid=%s", resource, separator, GetSID().c_str());
+
+    // the output file is only created once there is something to write to it
+    kodi::vfs::CFile outputFile;
+    bool opened = false;
+    int resultCode = HttpGet(path, [&](const char* data, size_t length)
+    {
+      if (!opened && !(opened = outputFile.OpenFileForWrite(fileName)))
+        return false;
+      outputFile.Write(data, length);
+      written += length;
+      return true;
+    });
+    if (opened)
+      outputFile.Close();
+    if (written == 0)
+    {
+      resultCode = HTTP_BADREQUEST;
+    }
+    int milliseconds = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+    kodi::Log(ADDON_LOG_DEBUG, "FileCopy (%s - %s) %d %zd %d %d", resource, fileName.c_str(), resultCode, written, milliseconds, BytesPerSecond(written, milliseconds));
+
+    return resultCode;
+  }
+  int Request::HttpGet(const std::string& resource, std::string& response, bool compressed)
+  {
+    // size the response up front when the length is known, otherwise grow it geometrically
+    size_t contentLength = 0;
+    return HttpGet(resource, [&](const char* data, size_t length)
+    {
+      if (response.capacity() < response.length() + length)
+        response.reserve(std::max({ contentLength, response.capacity() * 2, response.length() + length }));
+      response.append(data, length);
+      return true;
+    }, compressed, &contentLength);
+  }
+
+  int Request::HttpGet(const std::string& resource, const ConnectionPool::BodySink& sink, bool compressed, size_t* contentLength)
+  {
+    // limit the number of requests in flight to the backend
+    {
+      std::unique_lock<std::mutex> lock(m_mutexInFlight);
+      m_inFlightChanged.wait(lock, [this] { return m_inFlight < std::max(1, m_settings.m_maxConcurrentRequests); });
+      m_inFlight++;
+    }
 
-    // ask XBMC to read the URL for us
-    int resultCode = HTTP_NOTFOUND;
-    kodi::vfs::CFile inputStream;
-    ssize_t datalen;
-    if (inputStream.OpenFile(URL, ADDON_READ_NO_CACHE))
+    bool received = false;
+    auto tracked = [&](const char* data, size_t length)
     {
-      kodi::vfs::CFile outputFile;
-      if (outputFile.OpenFileForWrite(fileName))
+      received = true;
+      return sink(data, length);
+    };
+
+    int resultCode = -1;
+    // plain http requests reuse a pooled keep-alive connection
+    if (kodi::tools::StringUtils::StartsWith(m_settings.m_urlBase, "http://"))
+    {
+      resultCode = ConnectionPool::GetInstance().Get(m_settings.m_hostname, m_settings.m_port, resource, tracked, compressed, contentLength);
+      if (resultCode <= 0 && received)
+        resultCode = HTTP_BADREQUEST;
+      else if (resultCode <= 0)
+        kodi::Log(ADDON_LOG_DEBUG, "HttpGet falling back to Kodi for %s", resource.c_str());
+    }
+
+    if (resultCode <= 0)
+    {
+      // ask XBMC to read the URL for us
+      std::string URL = m_settings.m_urlBase + resource;
+      if (!compressed)
+        URL += "|Accept-Encoding=identity";
+
+      resultCode = HTTP_NOTFOUND;
+      kodi::vfs::CFile stream;
+      if (stream.OpenFile(URL, ADDON_READ_NO_CACHE))
       {
-        char buffer[1024];
-        while ((datalen = inputStream.Read( buffer, sizeof(buffer))))
+        resultCode = HTTP_OK;
+        if (contentLength)
+          *contentLength = static_cast<size_t>(std::max(stream.GetLength(), static_cast<int64_t>(0)));
+        std::vector<char> buffer(HTTP_READ_SIZE);
+        ssize_t count;
+        while ((count = stream.Read(buffer.data(), buffer.size())) > 0)
         {
-          outputFile.Write( buffer, datalen);
-          written += datalen;
+          if (!tracked(buffer.data(), count))
+          {
+            resultCode = HTTP_BADREQUEST;
+            break;
+          }
         }
-        inputStream.Close();
-        outputFile.Close();
-        resultCode = HTTP_OK;
+        stream.Close();
       }
     }
-    if (written == 0)
+
     {
-      resultCode = HTTP_BADREQUEST;
+      std::unique_lock<std::mutex> lock(m_mutexInFlight);
+      m_inFlight--;
     }
-    kodi::Log(ADDON_LOG_DEBUG, "FileCopy (%s - %s) %zu %d %d", resource, fileName.c_str(), resultCode, written, time(nullptr) - m_start);
-
+    m_inFlightChanged.notify_one();
     return resultCode;
   }
+
+  void Request::ClearSID()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutexSID);
+      m_sid.clear();
+      m_sidUpdate = 0;
+    }
+    ConnectionPool::GetInstance().Clear();
+  }
+
   bool Request::PingBackend()
   {
     const std::string URL = kodi::tools::StringUtils::Format("%s%s|connection-timeout=2", m_settings.m_urlBase, "/service?method=recording.lastupdated");
@@ -8,13 +8,16 @@
 
 #pragma once
 
+#include "ConnectionPool.h"
 #include "Settings.h"
 #if defined(TARGET_WINDOWS)
   #define WIN32_LEAN_AND_MEAN
   #include "windows.h"
 #endif
 #include <kodi/Filesystem.h>
+#include <condition_variable>
 #include <ctime>
+#include <functional>
 #include <mutex>
 #include <stdio.h>
 #include <stdlib.h>
@@ -42,17 +45,28 @@ namespace NextPVR
     int DoRequest(std::string resource, std::string& response);
     bool DoActionRequest(std::string resource);
     tinyxml2::XMLError DoMethodRequest(std::string resource, tinyxml2::XMLDocument& doc, bool compresssed = true);
+
+    /**
+     * Called with each <element> of a streamed response, return false to stop reading.
+     */
+    typedef std::function<bool(const tinyxml2::XMLElement* element)> ElementCallback;
+
+    /**
+     * Like DoMethodRequest but the response is never held as a whole, each complete
+     * <element> is parsed on its own and passed to the callback as it arrives.
+     */
+    tinyxml2::XMLError DoStreamingMethodRequest(std::string resource, const char* element, const ElementCallback& callback);
     int FileCopy(const char* resource, std::string fileName);
     tinyxml2::XMLError  GetLastUpdate(std::string resource, time_t& last_update);
     bool PingBackend();
     bool OneTimeSetup();
-    const char* GetSID() { return m_sid.c_str(); };
+    std::string GetSID() { std::lock_guard<std::mutex> lock(m_mutexSID); return m_sid; };
     std::vector<std::vector<std::string>> Discovery();
 
-    void SetSID(std::string newsid) { m_sid = newsid; };
-    void ClearSID() { m_sid.clear(); m_sidUpdate = 0; };
-    void RenewSID() { m_sidUpdate = time(nullptr); };
-    bool IsActiveSID() { return !m_sid.empty() && time(nullptr) < m_sidUpdate + 3600; };
+    void SetSID(std::string newsid) { std::lock_guard<std::mutex> lock(m_mutexSID); m_sid = newsid; };
+    void ClearSID();
+    void RenewSID() { std::lock_guard<std::mutex> lock(m_mutexSID); m_sidUpdate = time(nullptr); };
+    bool IsActiveSID() { std::lock_guard<std::mutex> lock(m_mutexSID); return !m_sid.empty() && time(nullptr) < m_sidUpdate + 3600; };
 
   private:
     Request() = default;
@@ -60,10 +74,19 @@ namespace NextPVR
     Request(Request const&) = delete;
     void operator=(Request const&) = delete;
 
+    bool GetMethodPath(const std::string& resource, std::string& path);
+    tinyxml2::XMLError CheckResponse(tinyxml2::XMLDocument& doc);
+    int HttpGet(const std::string& resource, const ConnectionPool::BodySink& sink, bool compressed = true, size_t* contentLength = nullptr);
+    int HttpGet(const std::string& resource, std::string& response, bool compressed = true);
+
     Settings& m_settings = Settings::GetInstance();
-    mutable std::mutex m_mutexRequest;
-    time_t m_start = 0;
+    // requests run concurrently, only the session state is shared
+    std::mutex m_mutexSID;
     std::string m_sid;
     time_t m_sidUpdate = 0;
+
+    std::mutex m_mutexInFlight;
+    std::condition_variable m_inFlightChanged;
+    int m_inFlight = 0;
   };
 } // namespace NextPVR
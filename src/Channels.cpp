@@ -11,6 +11,7 @@
 #include "pvrclient-nextpvr.h"
 
 #include <kodi/tools/StringUtils.h>
+#include <algorithm>
 
 using namespace NextPVR;
 using namespace NextPVR::utilities;
@@ -82,13 +83,17 @@ void Channels::DeleteChannelIcons()
 PVR_ERROR Channels::GetChannels(bool radio, kodi::addon::PVRChannelsResultSet& results)
 {
   std::string stream;
-  std::map<int, std::pair<bool, bool>>::iterator  itr = m_channelDetails.begin();
-  while (itr != m_channelDetails.end())
   {
-    if (itr->second.second == (radio == true))
-      itr = m_channelDetails.erase(itr);
-    else
-      ++itr;
+    std::unique_lock<std::mutex> lock(m_channelLock);
+    std::map<int, std::pair<bool, bool>>::iterator  itr = m_channelDetails.begin();
+    while (itr != m_channelDetails.end())
+    {
+      if (itr->second.second == (radio == true))
+        itr = m_channelDetails.erase(itr);
+      else
+        ++itr;
+    }
+    m_channelOrder.erase(std::remove_if(m_channelOrder.begin(), m_channelOrder.end(), [radio](const std::pair<int, bool>& channel) { return channel.second == radio; }), m_channelOrder.end());
   }
 
   tinyxml2::XMLDocument doc;
@@ -141,10 +146,14 @@ PVR_ERROR Channels::GetChannels(bool radio, kodi::addon::PVRChannelsResultSet& r
 
       // V5 has the EPG source type info.
       std::string epg;
-      if (XMLUtils::GetString(pChannelNode, "epg", epg))
-        m_channelDetails[tag.GetUniqueId()] = std::make_pair(epg == "None", tag.GetIsRadio());
-      else
-        m_channelDetails[tag.GetUniqueId()] = std::make_pair(false, tag.GetIsRadio());
+      {
+        std::unique_lock<std::mutex> lock(m_channelLock);
+        if (XMLUtils::GetString(pChannelNode, "epg", epg))
+          m_channelDetails[tag.GetUniqueId()] = std::make_pair(epg == "None", tag.GetIsRadio());
+        else
+          m_channelDetails[tag.GetUniqueId()] = std::make_pair(false, tag.GetIsRadio());
+        m_channelOrder.emplace_back(tag.GetUniqueId(), tag.GetIsRadio());
+      }
 
       // transfer channel to XBMC
       results.Add(tag);
@@ -153,6 +162,28 @@ PVR_ERROR Channels::GetChannels(bool radio, kodi::addon::PVRChannelsResultSet& r
   return PVR_ERROR_NO_ERROR;
 }
 
+bool Channels::IsGuideless(int uid)
+{
+  std::unique_lock<std::mutex> lock(m_channelLock);
+  auto it = m_channelDetails.find(uid);
+  return it != m_channelDetails.end() && it->second.first;
+}
+
+std::vector<int> Channels::GetGuideChannelsAfter(int uid, size_t count)
+{
+  std::vector<int> channels;
+  std::unique_lock<std::mutex> lock(m_channelLock);
+  auto it = std::find_if(m_channelOrder.begin(), m_channelOrder.end(), [uid](const std::pair<int, bool>& channel) { return channel.first == uid; });
+  if (it == m_channelOrder.end())
+    return channels;
+  for (++it; it != m_channelOrder.end() && channels.size() < count; ++it)
+  {
+    if (!m_channelDetails[it->first].first)
+      channels.push_back(it->first);
+  }
+  return channels;
+}
+
 /************************************************************/
 /** Channel group handling **/
 
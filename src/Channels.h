@@ -11,6 +11,8 @@
 
 #include "BackendRequest.h"
 #include <kodi/addon-instance/PVR.h>
+#include <mutex>
+#include <vector>
 
 namespace NextPVR
 {
@@ -45,6 +47,16 @@ namespace NextPVR
     PVR_RECORDING_CHANNEL_TYPE GetChannelType(unsigned int uid);
     std::map<int, std::pair<bool, bool>> m_channelDetails;
 
+    /**
+     * Whether the backend has no guide source for the channel.
+     */
+    bool IsGuideless(int uid);
+
+    /**
+     * Copy of up to count channels with a guide that follow uid in the backend channel order.
+     */
+    std::vector<int> GetGuideChannelsAfter(int uid, size_t count);
+
   private:
     Channels() = default;
 
@@ -54,5 +66,10 @@ namespace NextPVR
     std::string GetChannelIcon(int channelID);
     Settings& m_settings = Settings::GetInstance();
     Request& m_request = Request::GetInstance();
+
+    // guards m_channelDetails and m_channelOrder against the EPG prefetch thread
+    std::mutex m_channelLock;
+    // uid and radio flag in the order the backend lists them
+    std::vector<std::pair<int, bool>> m_channelOrder;
   };
 } // namespace NextPVR
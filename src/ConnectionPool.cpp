@@ -0,0 +1,321 @@
+/*
+ *  Copyright (C) 2005-2020 Team Kodi
+ *  https://kodi.tv
+ *
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *  See LICENSE.md for more information.
+ */
+
+#include "ConnectionPool.h"
+#include <kodi/General.h>
+#include <kodi/tools/StringUtils.h>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <zlib.h>
+
+namespace
+{
+  /**
+   * Inflates a gzip encoded body on its way to the sink.
+   */
+  class Inflater
+  {
+  public:
+    explicit Inflater(const NextPVR::ConnectionPool::BodySink& sink) : m_sink(sink)
+    {
+      memset(&m_stream, 0, sizeof(m_stream));
+      // 16 + MAX_WBITS selects the gzip wrapper
+      m_valid = inflateInit2(&m_stream, 16 + MAX_WBITS) == Z_OK;
+    }
+    ~Inflater()
+    {
+      if (m_valid)
+        inflateEnd(&m_stream);
+    }
+
+    bool Write(const char* data, size_t length)
+    {
+      if (!m_valid || m_done)
+        return m_valid;
+      m_stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+      m_stream.avail_in = static_cast<uInt>(length);
+      do
+      {
+        m_stream.next_out = reinterpret_cast<Bytef*>(m_buffer);
+        m_stream.avail_out = sizeof(m_buffer);
+        const int ret = inflate(&m_stream, Z_NO_FLUSH);
+        if (ret == Z_STREAM_END)
+          m_done = true;
+        else if (ret != Z_OK && ret != Z_BUF_ERROR)
+        {
+          kodi::Log(ADDON_LOG_ERROR, "ConnectionPool gzip body error %d", ret);
+          return false;
+        }
+        const size_t produced = sizeof(m_buffer) - m_stream.avail_out;
+        if (produced > 0 && !m_sink(m_buffer, produced))
+          return false;
+        if (ret == Z_BUF_ERROR)
+          break;
+      } while (!m_done && (m_stream.avail_in > 0 || m_stream.avail_out == 0));
+      return true;
+    }
+
+    /**
+     * Whether the whole gzip stream has been seen
+     */
+    bool Done() const { return m_done; }
+
+  private:
+    const NextPVR::ConnectionPool::BodySink& m_sink;
+    z_stream m_stream;
+    bool m_valid = false;
+    bool m_done = false;
+    char m_buffer[HTTP_READ_SIZE];
+  };
+}
+
+namespace NextPVR
+{
+  int ConnectionPool::Get(const std::string& host, int port, const std::string& path, const BodySink& sink, bool compressed, size_t* contentLength)
+  {
+    // a parked connection may have been closed by the backend in the meantime, allow one retry on a fresh one
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+      bool reused = false;
+      std::unique_ptr<Connection> connection = Acquire(host, port, reused);
+      if (!connection)
+        return -1;
+
+      bool keepAlive = false;
+      bool bodyStarted = false;
+      int status = Transfer(*connection, path, sink, compressed, contentLength, keepAlive, bodyStarted);
+      if (status > 0)
+      {
+        kodi::Log(ADDON_LOG_DEBUG, "ConnectionPool %s status %d connection %d use %d", path.c_str(), status, connection->id, connection->uses);
+        if (keepAlive)
+          Release(std::move(connection));
+        else
+          Discard(connection, "server close");
+        return status;
+      }
+      const bool timedOut = connection->timedOut;
+      Discard(connection, timedOut ? "receive timeout" : "transfer failed");
+      // a stalled backend will not answer a fresh connection any sooner, let the caller fall back
+      if (!reused || bodyStarted || timedOut)
+        break;
+    }
+    return -1;
+  }
+
+  void ConnectionPool::Clear()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (auto& connection : m_idle)
+      connection->socket->close();
+    m_idle.clear();
+  }
+
+  std::unique_ptr<ConnectionPool::Connection> ConnectionPool::Acquire(const std::string& host, int port, bool& reused)
+  {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      while (!m_idle.empty())
+      {
+        std::unique_ptr<Connection> connection = std::move(m_idle.back());
+        m_idle.pop_back();
+        // an idle socket should have nothing to read, if it does the backend has closed it
+        if (connection->host == host && connection->port == port && connection->socket->is_valid() && !connection->socket->read_ready(0))
+        {
+          connection->uses++;
+          reused = true;
+          return connection;
+        }
+        Discard(connection, "stale");
+      }
+    }
+
+    std::unique_ptr<Connection> connection(new Connection);
+    connection->socket.reset(new Socket(af_inet, pf_inet, sock_stream, tcp));
+    if (!connection->socket->create() || !connection->socket->connect(host, port))
+    {
+      kodi::Log(ADDON_LOG_ERROR, "ConnectionPool could not connect to %s:%d", host.c_str(), port);
+      connection->socket->close();
+      return nullptr;
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    connection->host = host;
+    connection->port = port;
+    connection->id = ++m_nextId;
+    connection->uses = 1;
+    return connection;
+  }
+
+  void ConnectionPool::Release(std::unique_ptr<Connection> connection)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_idle.size() < HTTP_POOL_SIZE && connection->pending.empty())
+      m_idle.push_back(std::move(connection));
+    else
+      Discard(connection, "pool full");
+  }
+
+  void ConnectionPool::Discard(std::unique_ptr<Connection>& connection, const char* reason)
+  {
+    kodi::Log(ADDON_LOG_DEBUG, "ConnectionPool closing connection %d after %d requests (%s)", connection->id, connection->uses, reason);
+    connection->socket->close();
+    connection.reset();
+  }
+
+  int ConnectionPool::Transfer(Connection& connection, const std::string& path, const BodySink& sink, bool compressed, size_t* contentLength, bool& keepAlive, bool& bodyStarted)
+  {
+    std::string target = path;
+    kodi::tools::StringUtils::Replace(target, " ", "%20");
+    const std::string request = kodi::tools::StringUtils::Format("GET %s HTTP/1.1\r\nHost: %s:%d\r\nConnection: keep-alive\r\nAccept-Encoding: %s\r\n\r\n",
+      target.c_str(), connection.host.c_str(), connection.port, compressed ? "gzip" : "identity");
+    if (connection.socket->send(request.c_str(), request.length()) != static_cast<int>(request.length()))
+      return -1;
+
+    std::string line;
+    if (!ReadLine(connection, line))
+      return -1;
+
+    int status = -1;
+    int minor = 0;
+    if (sscanf(line.c_str(), "HTTP/1.%d %d", &minor, &status) != 2)
+    {
+      kodi::Log(ADDON_LOG_ERROR, "ConnectionPool unexpected status line %s", line.c_str());
+      return -1;
+    }
+
+    keepAlive = minor >= 1;
+    bool chunked = false;
+    bool gzip = false;
+    size_t length = SIZE_MAX;
+    while (ReadLine(connection, line) && !line.empty())
+    {
+      const size_t colon = line.find(':');
+      if (colon == std::string::npos)
+        continue;
+      std::string name = line.substr(0, colon);
+      std::string value = line.substr(colon + 1);
+      kodi::tools::StringUtils::Trim(value);
+      if (kodi::tools::StringUtils::EqualsNoCase(name, "Content-Length"))
+        length = std::strtoull(value.c_str(), nullptr, 10);
+      else if (kodi::tools::StringUtils::EqualsNoCase(name, "Transfer-Encoding"))
+        chunked = kodi::tools::StringUtils::EqualsNoCase(value, "chunked");
+      else if (kodi::tools::StringUtils::EqualsNoCase(name, "Content-Encoding"))
+        gzip = kodi::tools::StringUtils::EqualsNoCase(value, "gzip");
+      else if (kodi::tools::StringUtils::EqualsNoCase(name, "Connection"))
+        keepAlive = !kodi::tools::StringUtils::EqualsNoCase(value, "close");
+    }
+    if (!line.empty())
+      return -1;
+
+    // only the body of a successful request goes to the caller
+    BodySink body = sink;
+    std::unique_ptr<Inflater> inflater;
+    if (status != 200)
+    {
+      body = [](const char*, size_t) { return true; };
+    }
+    else if (gzip)
+    {
+      inflater.reset(new Inflater(sink));
+      body = [&inflater](const char* data, size_t count) { return inflater->Write(data, count); };
+    }
+
+    // the length on the wire says nothing about the inflated size
+    if (contentLength)
+      *contentLength = (chunked || gzip || length == SIZE_MAX) ? 0 : length;
+
+    bodyStarted = true;
+    if (chunked)
+    {
+      while (true)
+      {
+        if (!ReadLine(connection, line))
+          return -1;
+        const size_t chunkLength = std::strtoul(line.c_str(), nullptr, 16);
+        if (chunkLength == 0)
+          break;
+        if (!ReadBody(connection, chunkLength, body) || !ReadLine(connection, line))
+          return -1;
+      }
+      // skip any trailers
+      while (ReadLine(connection, line) && !line.empty())
+        ;
+    }
+    else if (length != SIZE_MAX)
+    {
+      if (!ReadBody(connection, length, body))
+        return -1;
+    }
+    else
+    {
+      // no framing, the body runs to the end of the connection
+      keepAlive = false;
+      if (!ReadBody(connection, SIZE_MAX, body) && !connection.closed)
+        return -1;
+    }
+    if (inflater && !inflater->Done())
+    {
+      kodi::Log(ADDON_LOG_ERROR, "ConnectionPool gzip body ended early");
+      return -1;
+    }
+    return status;
+  }
+
+  bool ConnectionPool::Fill(Connection& connection)
+  {
+    // Socket::receive retries EAGAIN forever, wait with a deadline and take whatever a single read returns
+    const int ready = connection.socket->wait_readable(HTTP_RECEIVE_TIMEOUT * 1000);
+    if (ready <= 0)
+    {
+      if (ready == 0)
+      {
+        kodi::Log(ADDON_LOG_ERROR, "ConnectionPool connection %d no data for %d seconds", connection.id, HTTP_RECEIVE_TIMEOUT);
+        connection.timedOut = true;
+      }
+      return false;
+    }
+
+    // receive straight into the pending buffer
+    const size_t used = connection.pending.length();
+    connection.pending.resize(used + HTTP_READ_SIZE);
+    int count = connection.socket->receive(&connection.pending[used], HTTP_READ_SIZE, nullptr, 0, false);
+    connection.pending.resize(used + std::max(count, 0));
+    if (count == 0)
+      connection.closed = true;
+    return count > 0;
+  }
+
+  bool ConnectionPool::ReadLine(Connection& connection, std::string& line)
+  {
+    size_t end;
+    while ((end = connection.pending.find("\r\n")) == std::string::npos)
+    {
+      if (!Fill(connection))
+        return false;
+    }
+    line = connection.pending.substr(0, end);
+    connection.pending.erase(0, end + 2);
+    return true;
+  }
+
+  bool ConnectionPool::ReadBody(Connection& connection, size_t length, const BodySink& sink)
+  {
+    while (length > 0)
+    {
+      if (connection.pending.empty() && !Fill(connection))
+        return false;
+      const size_t count = std::min(length, connection.pending.length());
+      if (!sink(connection.pending.data(), count))
+        return false;
+      connection.pending.erase(0, count);
+      length -= count;
+    }
+    return true;
+  }
+} // namespace NextPVR
@@ -0,0 +1,94 @@
+/*
+ *  Copyright (C) 2005-2020 Team Kodi
+ *  https://kodi.tv
+ *
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *  See LICENSE.md for more information.
+ */
+
+#pragma once
+
+#include <kodi/AddonBase.h>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Socket.h"
+
+#define HTTP_POOL_SIZE 8
+#define HTTP_RECEIVE_TIMEOUT 30
+#define HTTP_READ_SIZE 65536
+
+namespace NextPVR
+{
+  /**
+   * Keep-alive HTTP/1.1 connections to the backend.
+   *
+   * Backend method calls are small and frequent, opening a new TCP connection
+   * for each of them costs more than the request itself. Idle connections are
+   * parked here and handed out again to the next request.
+   */
+  class ATTRIBUTE_HIDDEN ConnectionPool
+  {
+  public:
+    /**
+     * Called with each piece of the response body, return false to abort the transfer.
+     */
+    typedef std::function<bool(const char* data, size_t length)> BodySink;
+
+    static ConnectionPool& GetInstance()
+    {
+      static ConnectionPool pool;
+      return pool;
+    }
+
+    /**
+     * Issue a GET for path on host:port.
+     * @param compressed ask for a gzip encoded response, the sink always sees the inflated body
+     * @param contentLength set from the response headers before the body is passed to the sink, 0 when unknown
+     * @return the HTTP status code, or -1 if no usable response was received
+     */
+    int Get(const std::string& host, int port, const std::string& path, const BodySink& sink, bool compressed = false, size_t* contentLength = nullptr);
+
+    /**
+     * Close all idle connections.
+     */
+    void Clear();
+
+  private:
+    ConnectionPool() = default;
+    ~ConnectionPool() { Clear(); };
+
+    ConnectionPool(ConnectionPool const&) = delete;
+    void operator=(ConnectionPool const&) = delete;
+
+    struct Connection
+    {
+      std::unique_ptr<Socket> socket;
+      std::string host;
+      int port = 0;
+      int id = 0;
+      int uses = 0;
+      // bytes read past the end of the previous response
+      std::string pending;
+      // the backend closed the connection in an orderly way
+      bool closed = false;
+      // no data arrived within HTTP_RECEIVE_TIMEOUT
+      bool timedOut = false;
+    };
+
+    std::unique_ptr<Connection> Acquire(const std::string& host, int port, bool& reused);
+    void Release(std::unique_ptr<Connection> connection);
+    void Discard(std::unique_ptr<Connection>& connection, const char* reason);
+    int Transfer(Connection& connection, const std::string& path, const BodySink& sink, bool compressed, size_t* contentLength, bool& keepAlive, bool& bodyStarted);
+
+    bool Fill(Connection& connection);
+    bool ReadLine(Connection& connection, std::string& line);
+    bool ReadBody(Connection& connection, size_t length, const BodySink& sink);
+
+    std::mutex m_mutex;
+    std::vector<std::unique_ptr<Connection>> m_idle;
+    int m_nextId = 0;
+  };
+} // namespace NextPVR
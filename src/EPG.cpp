@@ -12,19 +12,56 @@
 #include "utilities/XMLUtils.h"
 
 #include <kodi/tools/StringUtils.h>
-#include <regex>
+#include <atomic>
+#include <chrono>
 
 using namespace NextPVR;
 using namespace NextPVR::utilities;
 
+namespace
+{
+  // match (\d+[.]?\d*) at pos, returning the end of the number or npos
+  size_t ScanDecimal(std::string_view value, size_t pos)
+  {
+    const size_t start = pos;
+    while (pos < value.length() && isdigit(static_cast<unsigned char>(value[pos])))
+      pos++;
+    if (pos == start)
+      return std::string::npos;
+    if (pos < value.length() && value[pos] == '.')
+      pos++;
+    while (pos < value.length() && isdigit(static_cast<unsigned char>(value[pos])))
+      pos++;
+    return pos;
+  }
+
+  // star ratings are "quotient" or "quotient/denominator", rating must be the whole text of its node
+  bool ParseStarRating(std::string_view rating, double& quotient, double& denominator)
+  {
+    size_t end = ScanDecimal(rating, 0);
+    if (end == std::string::npos)
+      return false;
+    quotient = std::atof(rating.data());
+    denominator = 0;
+    if (end == rating.length())
+      return true;
+    if (rating[end] != '/')
+      return false;
+    const size_t denominatorStart = end + 1;
+    end = ScanDecimal(rating, denominatorStart);
+    if (end != rating.length())
+      return false;
+    denominator = std::atof(rating.data() + denominatorStart);
+    return true;
+  }
+}
+
 /************************************************************/
 /** EPG handling */
 
 PVR_ERROR EPG::GetEPGForChannel(int channelUid, time_t start, time_t end, kodi::addon::PVREPGTagsResultSet& results)
 {
-  std::pair<bool, bool> channelDetail;
-  channelDetail = m_channels.m_channelDetails[channelUid];
-  if (channelDetail.first == true)
+  if (m_channels.IsGuideless(channelUid))
   {
     kodi::Log(ADDON_LOG_DEBUG, "Skipping %d", channelUid);
     return PVR_ERROR_NO_ERROR;
@@ -35,194 +72,396 @@ PVR_ERROR EPG::GetEPGForChannel(int channelUid, time_t start, time_t end, kodi::
     kodi::Log(ADDON_LOG_DEBUG, "Skipping expired EPG data %d %ld %lld", channelUid, start, end);
     return PVR_ERROR_INVALID_PARAMETERS;
   }
+
+  {
+    std::unique_lock<std::mutex> lock(m_mutexPrefetch);
+    // a background fetch of this channel is already under way, use it rather than asking twice
+    m_prefetchDone.wait_for(lock, std::chrono::seconds(EPG_PREFETCH_WAIT), [&] { return m_prefetching.count(channelUid) == 0; });
+    auto it = m_prefetched.find(channelUid);
+    if (it != m_prefetched.end())
+    {
+      if (it->second.start == start && it->second.end == end && time(nullptr) < it->second.fetched + EPG_PREFETCH_SECONDS)
+      {
+        kodi::Log(ADDON_LOG_DEBUG, "Prefetched EPG %d %d", channelUid, it->second.tags.size());
+        for (const auto& broadcast : it->second.tags)
+          results.Add(broadcast);
+        m_prefetched.erase(it);
+        return PVR_ERROR_NO_ERROR;
+      }
+      m_prefetched.erase(it);
+    }
+  }
+
+  // Kodi asks for one channel at a time, fetch the guide for the channels that follow this one in the background
+  StartPrefetch(channelUid, start, end);
+
+  // Kodi keeps what was added only when the update succeeds, a listing cut short must be reported
+  PVR_ERROR returnValue = PVR_ERROR_NO_ERROR;
+  if (UseCache())
+  {
+    std::vector<kodi::addon::PVREPGTag> tags;
+    if (LoadCachedGuide(channelUid, start, end, tags))
+    {
+      for (const auto& broadcast : tags)
+        results.Add(broadcast);
+    }
+    else
+    {
+      returnValue = PVR_ERROR_SERVER_ERROR;
+    }
+  }
+  else
+  {
+    // listings are added as they arrive rather than after the whole guide has been read
+    if (m_request.DoStreamingMethodRequest(ListingsRequest(channelUid, start, end), "l", [&](const tinyxml2::XMLElement* pListingNode)
+    {
+      kodi::addon::PVREPGTag broadcast;
+      ParseListing(pListingNode, channelUid, broadcast);
+      results.Add(broadcast);
+      return true;
+    }) != tinyxml2::XML_SUCCESS)
+    {
+      returnValue = PVR_ERROR_SERVER_ERROR;
+    }
+  }
+
+  return returnValue;
+}
+
+EPG::~EPG()
+{
+  if (m_prefetcher.joinable())
+    m_prefetcher.join();
+}
+
+void EPG::ClearPrefetch()
+{
+  std::unique_lock<std::mutex> lock(m_mutexPrefetch);
+  m_prefetched.clear();
+}
+
+void EPG::StartPrefetch(int channelUid, time_t start, time_t end)
+{
+  std::unique_lock<std::mutex> lock(m_mutexPrefetch);
+  // one batch at a time, Kodi moves on to the next channels while it runs
+  if (!m_prefetching.empty())
+    return;
+
+  std::vector<int> prefetch;
+  for (int uid : m_channels.GetGuideChannelsAfter(channelUid, EPG_PREFETCH_CHANNELS - 1))
+  {
+    if (m_prefetched.find(uid) == m_prefetched.end())
+      prefetch.push_back(uid);
+  }
+  if (prefetch.empty())
+    return;
+
+  // the previous batch has finished, only the thread itself is left to reap
+  if (m_prefetcher.joinable())
+    m_prefetcher.join();
+  m_prefetching.insert(prefetch.begin(), prefetch.end());
+  m_prefetcher = std::thread([this, prefetch, start, end] { Prefetch(prefetch, start, end); });
+}
+
+std::string EPG::ListingsRequest(int channelUid, time_t start, time_t end)
+{
   std::string request = kodi::tools::StringUtils::Format("channel.listings&channel_id=%d&start=%d&end=%d&genre=all", channelUid, static_cast<int>(start), static_cast<int>(end));
   if (m_settings.m_castcrew)
     request.append("&extras=true");
+  return request;
+}
+
+bool EPG::FetchListings(int channelUid, time_t start, time_t end, std::vector<kodi::addon::PVREPGTag>& tags)
+{
+  return m_request.DoStreamingMethodRequest(ListingsRequest(channelUid, start, end), "l", [&](const tinyxml2::XMLElement* pListingNode)
+  {
+    tags.emplace_back();
+    ParseListing(pListingNode, channelUid, tags.back());
+    return true;
+  }) == tinyxml2::XML_SUCCESS;
+}
+
+bool EPG::FetchGuide(int channelUid, time_t start, time_t end, std::vector<kodi::addon::PVREPGTag>& tags)
+{
+  if (UseCache())
+    return LoadCachedGuide(channelUid, start, end, tags);
+  return FetchListings(channelUid, start, end, tags);
+}
 
-  tinyxml2::XMLDocument doc;
+bool EPG::UseCache()
+{
+  // the cache is validated against the guide update time which older backends do not report
+  return m_settings.m_backendVersion >= 5007 && g_pvrclient->m_lastEPGUpdateTime != 0;
+}
+
+uint32_t EPG::CacheOptions()
+{
+  // settings that change how listings are converted
+  return (m_settings.m_castcrew ? 1 : 0) | (m_settings.m_genreString ? 2 : 0) | (m_settings.m_downloadGuideArtwork ? 4 : 0) |
+    (m_settings.m_guideArtPortrait ? 8 : 0) | (m_settings.m_showNew ? 16 : 0) | (m_settings.m_sendSidWithMetadata ? 32 : 0);
+}
 
-  if (m_request.DoMethodRequest(request, doc) == tinyxml2::XML_SUCCESS)
+bool EPG::LoadCachedGuide(int channelUid, time_t start, time_t end, std::vector<kodi::addon::PVREPGTag>& tags)
+{
+  const int64_t lastUpdate = g_pvrclient->m_lastEPGUpdateTime - m_settings.m_serverTimeOffset;
+  const uint32_t options = CacheOptions();
+  // artwork URLs can carry the session id which changes on every connection
+  const std::string sid = m_request.GetSID();
+
+  std::map<time_t, kodi::addon::PVREPGTag> merged;
+  std::vector<std::pair<time_t, time_t>> missing;
+  time_t cachedStart;
+  time_t cachedEnd;
+  std::vector<kodi::addon::PVREPGTag> cached;
+  if (m_cache.Load(channelUid, lastUpdate, options, cachedStart, cachedEnd, cached) && cachedStart < end && cachedEnd > start)
   {
-    tinyxml2::XMLNode* listingsNode = doc.RootElement()->FirstChildElement("listings");
-    for (tinyxml2::XMLNode* pListingNode = listingsNode->FirstChildElement("l"); pListingNode; pListingNode = pListingNode->NextSiblingElement())
+    for (auto& broadcast : cached)
     {
-      kodi::addon::PVREPGTag broadcast;
-      std::string title;
-      std::string description;
-      std::string subtitle;
-      XMLUtils::GetString(pListingNode, "name", title);
-      XMLUtils::GetString(pListingNode, "description", description);
+      if (broadcast.GetEndTime() > start && broadcast.GetStartTime() < end)
+      {
+        std::string icon = broadcast.GetIconPath();
+        if (!sid.empty() && kodi::tools::StringUtils::Replace(icon, "$SID", sid))
+          broadcast.SetIconPath(icon);
+        merged[broadcast.GetStartTime()] = broadcast;
+      }
+    }
+    // only the parts of the window outside what was cached are fetched
+    if (start < cachedStart)
+      missing.emplace_back(start, cachedStart);
+    if (end > cachedEnd)
+      missing.emplace_back(cachedEnd, end);
+  }
+  else
+  {
+    missing.emplace_back(start, end);
+  }
+
+  for (const auto& window : missing)
+  {
+    std::vector<kodi::addon::PVREPGTag> fetched;
+    if (!FetchListings(channelUid, window.first, window.second, fetched))
+      return false;
+    for (const auto& broadcast : fetched)
+      merged[broadcast.GetStartTime()] = broadcast;
+  }
+
+  tags.clear();
+  tags.reserve(merged.size());
+  for (const auto& entry : merged)
+    tags.push_back(entry.second);
+  kodi::Log(ADDON_LOG_DEBUG, "EPG for %d %d listings %d fetched windows", channelUid, tags.size(), missing.size());
 
-      if (XMLUtils::GetString(pListingNode, "subtitle", subtitle))
+  if (!missing.empty())
+  {
+    std::vector<kodi::addon::PVREPGTag> store(tags);
+    if (!sid.empty())
+    {
+      for (auto& broadcast : store)
+      {
+        std::string icon = broadcast.GetIconPath();
+        if (kodi::tools::StringUtils::Replace(icon, sid, "$SID"))
+          broadcast.SetIconPath(icon);
+      }
+    }
+    m_cache.Save(channelUid, lastUpdate, options, start, end, store);
+  }
+  return true;
+}
+
+void EPG::Prefetch(const std::vector<int>& channels, time_t start, time_t end)
+{
+  // the request limit still applies, one of the slots is used by the caller
+  const int workers = std::min(static_cast<int>(channels.size()), std::max(1, m_settings.m_maxConcurrentRequests - 1));
+  std::atomic<size_t> next{0};
+  std::vector<std::thread> threads;
+  for (int i = 0; i < workers; i++)
+  {
+    threads.emplace_back([&]
+    {
+      size_t index;
+      while ((index = next++) < channels.size())
       {
-        if (description != subtitle + ":" && kodi::tools::StringUtils::StartsWith(description, subtitle + ": "))
+        const int channelUid = channels[index];
+        PrefetchedGuide guide{start, end, 0, {}};
+        const bool fetched = FetchGuide(channelUid, start, end, guide.tags);
+        std::unique_lock<std::mutex> lock(m_mutexPrefetch);
+        if (fetched)
         {
-          description = description.substr(subtitle.length() + 2);
+          guide.fetched = time(nullptr);
+          m_prefetched[channelUid] = std::move(guide);
         }
+        m_prefetching.erase(channelUid);
+        m_prefetchDone.notify_all();
       }
+    });
+  }
+  for (auto& thread : threads)
+    thread.join();
+}
+
+void EPG::ParseListing(const tinyxml2::XMLNode* pListingNode, int channelUid, kodi::addon::PVREPGTag& broadcast)
+{
+  std::string title;
+  std::string description;
+  std::string subtitle;
+  XMLUtils::GetString(pListingNode, "name", title);
+  XMLUtils::GetString(pListingNode, "description", description);
+
+  if (XMLUtils::GetString(pListingNode, "subtitle", subtitle))
+  {
+    if (description != subtitle + ":" && kodi::tools::StringUtils::StartsWith(description, subtitle + ": "))
+    {
+      description = description.substr(subtitle.length() + 2);
+    }
+  }
 
-      broadcast.SetYear(XMLUtils::GetIntValue(pListingNode, "year"));
+  broadcast.SetYear(XMLUtils::GetIntValue(pListingNode, "year"));
 
-      std::string startTime;
-      std::string endTime;
-      XMLUtils::GetString(pListingNode, "start", startTime);
-      startTime.resize(10);
-      XMLUtils::GetString(pListingNode, "end", endTime);
-      endTime.resize(10);
+  time_t startTime = 0;
+  time_t endTime = 0;
+  XMLUtils::GetEpochSeconds(pListingNode, "start", startTime);
+  XMLUtils::GetEpochSeconds(pListingNode, "end", endTime);
 
-      const std::string oidLookup(endTime + ":" + std::to_string(channelUid));
+  broadcast.SetTitle(title);
+  broadcast.SetEpisodeName(subtitle);
+  broadcast.SetUniqueChannelId(channelUid);
+  broadcast.SetStartTime(startTime);
+  broadcast.SetUniqueBroadcastId(static_cast<unsigned int>(endTime));
+  broadcast.SetEndTime(endTime);
+  broadcast.SetPlot(description);
 
-      broadcast.SetTitle(title);
-      broadcast.SetEpisodeName(subtitle);
-      broadcast.SetUniqueChannelId(channelUid);
-      broadcast.SetStartTime(stol(startTime));
-      broadcast.SetUniqueBroadcastId(stoi(endTime));
-      broadcast.SetEndTime(stol(endTime));
-      broadcast.SetPlot(description);
+  std::string artworkPath;
+  if (m_settings.m_downloadGuideArtwork)
+  {
+    // artwork URL
+    if (m_settings.m_backendVersion < 50000)
+    {
+      const int epgOid = XMLUtils::GetIntValue(pListingNode, "id");
+      artworkPath = kodi::tools::StringUtils::Format("%s/service?method=channel.show.artwork&sid=%s&event_id=%d", m_settings.m_urlBase, m_request.GetSID().c_str(), epgOid);
+    }
+    else
+    {
+      if (m_settings.m_sendSidWithMetadata)
+        artworkPath = kodi::tools::StringUtils::Format("%s/service?method=channel.show.artwork&sid=%s&name=%s", m_settings.m_urlBase, m_request.GetSID().c_str(), UriEncode(title).c_str());
+      else
+        artworkPath = kodi::tools::StringUtils::Format("%s/service?method=channel.show.artwork&name=%s", m_settings.m_urlBase, UriEncode(title).c_str());
+      if (m_settings.m_guideArtPortrait)
+        artworkPath += "&prefer=poster";
+    }
+    broadcast.SetIconPath(artworkPath);
+  }
+  std::string sGenre;
+  if (XMLUtils::GetString(pListingNode, "genre", sGenre))
+  {
+    broadcast.SetGenreDescription(sGenre);
+    broadcast.SetGenreType(EPG_GENRE_USE_STRING);
+  }
+  else
+  {
+    // genre type
+    broadcast.SetGenreType(XMLUtils::GetIntValue(pListingNode, "genre_type"));
+    broadcast.SetGenreSubType(XMLUtils::GetIntValue(pListingNode, "genre_sub_type"));
 
-      std::string artworkPath;
-      if (m_settings.m_downloadGuideArtwork)
+  }
+  std::string allGenres;
+  if (XMLUtils::GetAdditiveString(pListingNode->FirstChildElement("genres"), "genre", EPG_STRING_TOKEN_SEPARATOR, allGenres, true))
+  {
+    if (allGenres.find(EPG_STRING_TOKEN_SEPARATOR) != std::string::npos)
+    {
+      if (broadcast.GetGenreType() != EPG_GENRE_USE_STRING)
       {
-        // artwork URL
-        if (m_settings.m_backendVersion < 50000)
-        {
-          const int epgOid = XMLUtils::GetIntValue(pListingNode, "id");
-          artworkPath = kodi::tools::StringUtils::Format("%s/service?method=channel.show.artwork&sid=%s&event_id=%d", m_settings.m_urlBase, m_request.GetSID(), epgOid);
-        }
-        else
-        {
-          if (m_settings.m_sendSidWithMetadata)
-            artworkPath = kodi::tools::StringUtils::Format("%s/service?method=channel.show.artwork&sid=%s&name=%s", m_settings.m_urlBase, m_request.GetSID(), UriEncode(title).c_str());
-          else
-            artworkPath = kodi::tools::StringUtils::Format("%s/service?method=channel.show.artwork&name=%s", m_settings.m_urlBase, UriEncode(title).c_str());
-          if (m_settings.m_guideArtPortrait)
-            artworkPath += "&prefer=poster";
-        }
-        broadcast.SetIconPath(artworkPath);
+        broadcast.SetGenreSubType(EPG_GENRE_USE_STRING);
       }
-      std::string sGenre;
-      if (XMLUtils::GetString(pListingNode, "genre", sGenre))
+      broadcast.SetGenreDescription(allGenres);
+    }
+    else if (m_settings.m_genreString && broadcast.GetGenreSubType() != EPG_GENRE_USE_STRING)
+    {
+      broadcast.SetGenreDescription(allGenres);
+      broadcast.SetGenreSubType(EPG_GENRE_USE_STRING);
+    }
+
+  }
+  broadcast.SetSeriesNumber(XMLUtils::GetIntValue(pListingNode, "season", EPG_TAG_INVALID_SERIES_EPISODE));
+  broadcast.SetEpisodeNumber(XMLUtils::GetIntValue(pListingNode, "episode", EPG_TAG_INVALID_SERIES_EPISODE));
+  broadcast.SetEpisodePartNumber(EPG_TAG_INVALID_SERIES_EPISODE);
+
+  std::string original;
+  XMLUtils::GetString(pListingNode, "original", original);
+  broadcast.SetFirstAired(original);
+
+  bool firstrun;
+  if (XMLUtils::GetBoolean(pListingNode, "firstrun", firstrun))
+  {
+    if (firstrun)
+    {
+      std::string_view significance;
+      XMLUtils::GetStringView(pListingNode, "significance", significance);
+      if (significance == "Live")
       {
-        broadcast.SetGenreDescription(sGenre);
-        broadcast.SetGenreType(EPG_GENRE_USE_STRING);
+        broadcast.SetFlags(EPG_TAG_FLAG_IS_LIVE);
       }
-      else
+      else if (significance.find("Premiere") != std::string_view::npos)
       {
-        // genre type
-        broadcast.SetGenreType(XMLUtils::GetIntValue(pListingNode, "genre_type"));
-        broadcast.SetGenreSubType(XMLUtils::GetIntValue(pListingNode, "genre_sub_type"));
-
+        broadcast.SetFlags(EPG_TAG_FLAG_IS_PREMIERE);
       }
-      std::string allGenres;
-      if (XMLUtils::GetAdditiveString(pListingNode->FirstChildElement("genres"), "genre", EPG_STRING_TOKEN_SEPARATOR, allGenres, true))
+      else if (significance.find("Finale") != std::string_view::npos)
       {
-        if (allGenres.find(EPG_STRING_TOKEN_SEPARATOR) != std::string::npos)
-        {
-          if (broadcast.GetGenreType() != EPG_GENRE_USE_STRING)
-          {
-            broadcast.SetGenreSubType(EPG_GENRE_USE_STRING);
-          }
-          broadcast.SetGenreDescription(allGenres);
-        }
-        else if (m_settings.m_genreString && broadcast.GetGenreSubType() != EPG_GENRE_USE_STRING)
-        {
-          broadcast.SetGenreDescription(allGenres);
-          broadcast.SetGenreSubType(EPG_GENRE_USE_STRING);
-        }
-
+        broadcast.SetFlags(EPG_TAG_FLAG_IS_FINALE);
       }
-      broadcast.SetSeriesNumber(XMLUtils::GetIntValue(pListingNode, "season", EPG_TAG_INVALID_SERIES_EPISODE));
-      broadcast.SetEpisodeNumber(XMLUtils::GetIntValue(pListingNode, "episode", EPG_TAG_INVALID_SERIES_EPISODE));
-      broadcast.SetEpisodePartNumber(EPG_TAG_INVALID_SERIES_EPISODE);
-
-      std::string original;
-      XMLUtils::GetString(pListingNode, "original", original);
-      broadcast.SetFirstAired(original);
-
-      bool firstrun;
-      if (XMLUtils::GetBoolean(pListingNode, "firstrun", firstrun))
+      else if (m_settings.m_showNew)
       {
-        if (firstrun)
-        {
-          std::string significance;
-          XMLUtils::GetString(pListingNode, "significance", significance);
-          if (significance == "Live")
-          {
-            broadcast.SetFlags(EPG_TAG_FLAG_IS_LIVE);
-          }
-          else if (significance.find("Premiere") != std::string::npos)
-          {
-            broadcast.SetFlags(EPG_TAG_FLAG_IS_PREMIERE);
-          }
-          else if (significance.find("Finale") != std::string::npos)
-          {
-            broadcast.SetFlags(EPG_TAG_FLAG_IS_FINALE);
-          }
-          else if (m_settings.m_showNew)
-          {
-            broadcast.SetFlags(EPG_TAG_FLAG_IS_NEW);
-          }
-        }
+        broadcast.SetFlags(EPG_TAG_FLAG_IS_NEW);
       }
-      if (m_settings.m_castcrew)
+    }
+  }
+  if (m_settings.m_castcrew)
+  {
+    std::string castcrew;
+    XMLUtils::GetString(pListingNode, "cast", castcrew);
+    std::replace(castcrew.begin(), castcrew.end(), ';', ',');
+    kodi::tools::StringUtils::Replace(castcrew, "Actor:", "");
+    kodi::tools::StringUtils::Replace(castcrew, "Host:", "");
+    broadcast.SetCast(castcrew);
+
+    castcrew.clear();
+    XMLUtils::GetString(pListingNode, "crew", castcrew);
+    std::vector<std::string> allcrew = kodi::tools::StringUtils::Split(castcrew, ";", 0);
+    std::string writer;
+    std::string director;
+    for (auto it = allcrew.begin(); it != allcrew.end(); ++it)
+    {
+      std::vector<std::string> onecrew = kodi::tools::StringUtils::Split(*it, ":", 0);
+      if (onecrew.size() == 2)
       {
-        std::string castcrew;
-        XMLUtils::GetString(pListingNode, "cast", castcrew);
-        std::replace(castcrew.begin(), castcrew.end(), ';', ',');
-        kodi::tools::StringUtils::Replace(castcrew, "Actor:", "");
-        kodi::tools::StringUtils::Replace(castcrew, "Host:", "");
-        broadcast.SetCast(castcrew);
-
-        castcrew.clear();
-        XMLUtils::GetString(pListingNode, "crew", castcrew);
-        std::vector<std::string> allcrew = kodi::tools::StringUtils::Split(castcrew, ";", 0);
-        std::string writer;
-        std::string director;
-        for (auto it = allcrew.begin(); it != allcrew.end(); ++it)
+        if (kodi::tools::StringUtils::ContainsKeyword(onecrew[0].c_str(), { "Writer", "Screenwriter" }))
         {
-          std::vector<std::string> onecrew = kodi::tools::StringUtils::Split(*it, ":", 0);
-          if (onecrew.size() == 2)
-          {
-            if (kodi::tools::StringUtils::ContainsKeyword(onecrew[0].c_str(), { "Writer", "Screenwriter" }))
-            {
-              if (!writer.empty())
-                writer.append(EPG_STRING_TOKEN_SEPARATOR);
-              writer.append(onecrew[1]);
-            }
-            if (onecrew[0] == "Director")
-            {
-              if (!director.empty())
-                director.append(EPG_STRING_TOKEN_SEPARATOR);
-              director.append(onecrew[1]);
-            }
-          }
+          if (!writer.empty())
+            writer.append(EPG_STRING_TOKEN_SEPARATOR);
+          writer.append(onecrew[1]);
         }
-        broadcast.SetDirector(director);
-        broadcast.SetWriter(writer);
-      }
-      std::string rating;
-      if (XMLUtils::GetString(pListingNode, "star_rating", rating))
-      {
-        std::regex base_regex("(\\d+[.]?\\d*)(?:(?:/)(\\d+[.]?\\d*))?");
-        std::smatch base_match;
-        if (std::regex_match(rating, base_match, base_regex))
+        if (onecrew[0] == "Director")
         {
-          if (base_match.size() == 3)
-          {
-            double quotient = std::atof(base_match[1].str().c_str());
-            double denominator = std::atof(base_match[2].str().c_str());
-            // if single value passed assume base 4
-            if (denominator == 0)
-              denominator = 4;
-            int starRating = (quotient / denominator * 10.0) + 0.5;
-            broadcast.SetStarRating(starRating);
-          }
+          if (!director.empty())
+            director.append(EPG_STRING_TOKEN_SEPARATOR);
+          director.append(onecrew[1]);
         }
       }
-      results.Add(broadcast);
     }
-    return PVR_ERROR_NO_ERROR;
+    broadcast.SetDirector(director);
+    broadcast.SetWriter(writer);
+  }
+  std::string_view rating;
+  if (XMLUtils::GetStringView(pListingNode, "star_rating", rating))
+  {
+    double quotient;
+    double denominator;
+    if (ParseStarRating(rating, quotient, denominator))
+    {
+      // if single value passed assume base 4
+      if (denominator == 0)
+        denominator = 4;
+      int starRating = (quotient / denominator * 10.0) + 0.5;
+      broadcast.SetStarRating(starRating);
+    }
   }
-
-  return PVR_ERROR_NO_ERROR;
 }
@@ -12,7 +12,21 @@
 #include "BackendRequest.h"
 #include <kodi/addon-instance/PVR.h>
 #include "Channels.h"
+#include "EPGCache.h"
 #include "Recordings.h"
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+// channels fetched together when the guide for one of them is requested
+#define EPG_PREFETCH_CHANNELS 8
+// how long a prefetched guide is kept waiting for Kodi to ask for it
+#define EPG_PREFETCH_SECONDS 600
+// longest wait for a channel that is being prefetched before fetching it directly
+#define EPG_PREFETCH_WAIT 30
 
 namespace NextPVR
 {
@@ -29,10 +43,41 @@ namespace NextPVR
     }
     PVR_ERROR GetEPGForChannel(int channelUid, time_t start, time_t end, kodi::addon::PVREPGTagsResultSet& results);
 
+    /**
+     * Drop prefetched guide data, called when the backend guide has changed.
+     */
+    void ClearPrefetch();
+
   private:
     EPG() = default;
+    ~EPG();
     EPG(EPG const&) = delete;
     void operator=(EPG const&) = delete;
+    void ParseListing(const tinyxml2::XMLNode* pListingNode, int channelUid, kodi::addon::PVREPGTag& broadcast);
+    std::string ListingsRequest(int channelUid, time_t start, time_t end);
+    bool FetchListings(int channelUid, time_t start, time_t end, std::vector<kodi::addon::PVREPGTag>& tags);
+    bool FetchGuide(int channelUid, time_t start, time_t end, std::vector<kodi::addon::PVREPGTag>& tags);
+    bool LoadCachedGuide(int channelUid, time_t start, time_t end, std::vector<kodi::addon::PVREPGTag>& tags);
+    bool UseCache();
+    uint32_t CacheOptions();
+    void StartPrefetch(int channelUid, time_t start, time_t end);
+    void Prefetch(const std::vector<int>& channels, time_t start, time_t end);
+
+    struct PrefetchedGuide
+    {
+      time_t start;
+      time_t end;
+      time_t fetched;
+      std::vector<kodi::addon::PVREPGTag> tags;
+    };
+    std::mutex m_mutexPrefetch;
+    std::map<int, PrefetchedGuide> m_prefetched;
+    // channels the prefetch thread has still to fetch
+    std::set<int> m_prefetching;
+    std::condition_variable m_prefetchDone;
+    std::thread m_prefetcher;
+
+    EPGCache m_cache;
 
     Settings& m_settings = Settings::GetInstance();
     Request& m_request = Request::GetInstance();
@@ -0,0 +1,201 @@
+/*
+ *  Copyright (C) 2020 Team Kodi
+ *  https://kodi.tv
+ *
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *  See LICENSE.md for more information.
+ */
+
+#include "EPGCache.h"
+
+#include <kodi/Filesystem.h>
+#include <kodi/General.h>
+#include <kodi/tools/StringUtils.h>
+#include <cstring>
+
+using namespace NextPVR;
+
+namespace
+{
+  const uint32_t EPG_CACHE_MAGIC = 0x4745504E; // "NPEG"
+  const uint32_t EPG_CACHE_VERSION = 1;
+
+  class Writer
+  {
+  public:
+    template<typename T> void Put(T value)
+    {
+      m_data.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+    void Put(const std::string& value)
+    {
+      Put(static_cast<uint32_t>(value.length()));
+      m_data.append(value);
+    }
+    const std::string& Data() const { return m_data; }
+
+  private:
+    std::string m_data;
+  };
+
+  class Reader
+  {
+  public:
+    explicit Reader(const std::string& data) : m_data(data) {}
+    template<typename T> bool Get(T& value)
+    {
+      if (m_offset + sizeof(value) > m_data.length())
+        return false;
+      memcpy(&value, m_data.data() + m_offset, sizeof(value));
+      m_offset += sizeof(value);
+      return true;
+    }
+    bool Get(std::string& value)
+    {
+      uint32_t length;
+      if (!Get(length) || m_offset + length > m_data.length())
+        return false;
+      value.assign(m_data, m_offset, length);
+      m_offset += length;
+      return true;
+    }
+
+  private:
+    const std::string& m_data;
+    size_t m_offset = 0;
+  };
+}
+
+std::string EPGCache::FileName(int channelUid)
+{
+  return kodi::tools::StringUtils::Format("%schannel_%d.bin", EPG_CACHE_FOLDER, channelUid);
+}
+
+bool EPGCache::Load(int channelUid, int64_t lastUpdate, uint32_t options, time_t& start, time_t& end, std::vector<kodi::addon::PVREPGTag>& tags)
+{
+  kodi::vfs::CFile file;
+  if (!file.OpenFile(FileName(channelUid)))
+    return false;
+  std::string data;
+  char buffer[16384];
+  ssize_t count;
+  while ((count = file.Read(buffer, sizeof(buffer))) > 0)
+    data.append(buffer, count);
+  file.Close();
+
+  Reader reader(data);
+  uint32_t magic, version, fileOptions, entries;
+  int64_t fileLastUpdate, fileStart, fileEnd;
+  if (!reader.Get(magic) || magic != EPG_CACHE_MAGIC || !reader.Get(version) || version != EPG_CACHE_VERSION)
+    return false;
+  if (!reader.Get(fileLastUpdate) || !reader.Get(fileOptions) || !reader.Get(fileStart) || !reader.Get(fileEnd) || !reader.Get(entries))
+    return false;
+  if (fileLastUpdate != lastUpdate || fileOptions != options)
+  {
+    kodi::Log(ADDON_LOG_DEBUG, "EPG cache for %d is out of date", channelUid);
+    return false;
+  }
+
+  std::vector<kodi::addon::PVREPGTag> loaded;
+  loaded.reserve(entries);
+  for (uint32_t i = 0; i < entries; i++)
+  {
+    int64_t tagStart, tagEnd;
+    uint32_t broadcastId, flags;
+    int32_t year, genreType, genreSubType, season, episode, starRating;
+    std::string title, subtitle, plot, genre, firstAired, cast, director, writer, icon;
+    if (!reader.Get(tagStart) || !reader.Get(tagEnd) || !reader.Get(broadcastId) || !reader.Get(flags) ||
+        !reader.Get(year) || !reader.Get(genreType) || !reader.Get(genreSubType) || !reader.Get(season) ||
+        !reader.Get(episode) || !reader.Get(starRating) || !reader.Get(title) || !reader.Get(subtitle) ||
+        !reader.Get(plot) || !reader.Get(genre) || !reader.Get(firstAired) || !reader.Get(cast) ||
+        !reader.Get(director) || !reader.Get(writer) || !reader.Get(icon))
+    {
+      kodi::Log(ADDON_LOG_ERROR, "EPG cache for %d is damaged", channelUid);
+      return false;
+    }
+    kodi::addon::PVREPGTag broadcast;
+    broadcast.SetUniqueChannelId(channelUid);
+    broadcast.SetStartTime(static_cast<time_t>(tagStart));
+    broadcast.SetEndTime(static_cast<time_t>(tagEnd));
+    broadcast.SetUniqueBroadcastId(broadcastId);
+    broadcast.SetFlags(flags);
+    broadcast.SetYear(year);
+    broadcast.SetGenreType(genreType);
+    broadcast.SetGenreSubType(genreSubType);
+    broadcast.SetSeriesNumber(season);
+    broadcast.SetEpisodeNumber(episode);
+    broadcast.SetEpisodePartNumber(EPG_TAG_INVALID_SERIES_EPISODE);
+    broadcast.SetStarRating(starRating);
+    broadcast.SetTitle(title);
+    broadcast.SetEpisodeName(subtitle);
+    broadcast.SetPlot(plot);
+    broadcast.SetGenreDescription(genre);
+    broadcast.SetFirstAired(firstAired);
+    broadcast.SetCast(cast);
+    broadcast.SetDirector(director);
+    broadcast.SetWriter(writer);
+    if (!icon.empty())
+      broadcast.SetIconPath(icon);
+    loaded.push_back(broadcast);
+  }
+  start = static_cast<time_t>(fileStart);
+  end = static_cast<time_t>(fileEnd);
+  tags.swap(loaded);
+  return true;
+}
+
+bool EPGCache::Save(int channelUid, int64_t lastUpdate, uint32_t options, time_t start, time_t end, const std::vector<kodi::addon::PVREPGTag>& tags)
+{
+  Writer writer;
+  writer.Put(EPG_CACHE_MAGIC);
+  writer.Put(EPG_CACHE_VERSION);
+  writer.Put(lastUpdate);
+  writer.Put(options);
+  writer.Put(static_cast<int64_t>(start));
+  writer.Put(static_cast<int64_t>(end));
+  writer.Put(static_cast<uint32_t>(tags.size()));
+  for (const auto& broadcast : tags)
+  {
+    writer.Put(static_cast<int64_t>(broadcast.GetStartTime()));
+    writer.Put(static_cast<int64_t>(broadcast.GetEndTime()));
+    writer.Put(static_cast<uint32_t>(broadcast.GetUniqueBroadcastId()));
+    writer.Put(static_cast<uint32_t>(broadcast.GetFlags()));
+    writer.Put(static_cast<int32_t>(broadcast.GetYear()));
+    writer.Put(static_cast<int32_t>(broadcast.GetGenreType()));
+    writer.Put(static_cast<int32_t>(broadcast.GetGenreSubType()));
+    writer.Put(static_cast<int32_t>(broadcast.GetSeriesNumber()));
+    writer.Put(static_cast<int32_t>(broadcast.GetEpisodeNumber()));
+    writer.Put(static_cast<int32_t>(broadcast.GetStarRating()));
+    writer.Put(broadcast.GetTitle());
+    writer.Put(broadcast.GetEpisodeName());
+    writer.Put(broadcast.GetPlot());
+    writer.Put(broadcast.GetGenreDescription());
+    writer.Put(broadcast.GetFirstAired());
+    writer.Put(broadcast.GetCast());
+    writer.Put(broadcast.GetDirector());
+    writer.Put(broadcast.GetWriter());
+    writer.Put(broadcast.GetIconPath());
+  }
+
+  if (!kodi::vfs::DirectoryExists(EPG_CACHE_FOLDER))
+    kodi::vfs::CreateDirectory(EPG_CACHE_FOLDER);
+
+  // write to a temporary file so an interrupted save never leaves a damaged cache behind
+  const std::string fileName = FileName(channelUid);
+  const std::string tempName = fileName + ".tmp";
+  kodi::vfs::CFile file;
+  if (!file.OpenFileForWrite(tempName, true))
+  {
+    kodi::Log(ADDON_LOG_ERROR, "Cannot write EPG cache %s", tempName.c_str());
+    return false;
+  }
+  const bool written = file.Write(writer.Data().data(), writer.Data().length()) == static_cast<ssize_t>(writer.Data().length());
+  file.Close();
+  if (!written)
+  {
+    kodi::vfs::DeleteFile(tempName);
+    return false;
+  }
+  kodi::vfs::DeleteFile(fileName);
+  return kodi::vfs::RenameFile(tempName, fileName);
+}
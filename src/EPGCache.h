@@ -0,0 +1,44 @@
+/*
+ *  Copyright (C) 2020 Team Kodi
+ *  https://kodi.tv
+ *
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *  See LICENSE.md for more information.
+ */
+
+
+#pragma once
+
+#include <kodi/addon-instance/PVR.h>
+#include <string>
+#include <vector>
+
+#define EPG_CACHE_FOLDER "special://userdata/addon_data/pvr.nextpvr/epg/"
+
+namespace NextPVR
+{
+  /**
+   * Guide listings kept on disk between sessions, one file per channel.
+   *
+   * A file is only valid for the backend guide it was written from (the system.epg.summary
+   * last_update value) and for the guide settings that shaped the listings.
+   */
+  class ATTRIBUTE_HIDDEN EPGCache
+  {
+  public:
+    /**
+     * Read the cached guide for a channel.
+     * @param start,end the window the cached listings cover
+     * @return false when there is no file or it does not match lastUpdate and options
+     */
+    bool Load(int channelUid, int64_t lastUpdate, uint32_t options, time_t& start, time_t& end, std::vector<kodi::addon::PVREPGTag>& tags);
+
+    /**
+     * Replace the cached guide for a channel.
+     */
+    bool Save(int channelUid, int64_t lastUpdate, uint32_t options, time_t start, time_t end, const std::vector<kodi::addon::PVREPGTag>& tags);
+
+  private:
+    std::string FileName(int channelUid);
+  };
+} // namespace NextPVR
@@ -12,7 +12,6 @@
 #include <kodi/General.h>
 #include "pvrclient-nextpvr.h"
 
-#include <regex>
 #include <unordered_set>
 
 #include <kodi/tools/StringUtils.h>
@@ -20,6 +19,23 @@
 using namespace NextPVR;
 using namespace NextPVR::utilities;
 
+namespace
+{
+  // match S(\d\d)E(\d+) at pos, returning the end of the match or npos
+  size_t ScanSeasonEpisode(const std::string& value, size_t pos, int& season, int& episode)
+  {
+    auto digit = [&value](size_t i) { return i < value.length() && isdigit(static_cast<unsigned char>(value[i])); };
+    if (pos >= value.length() || value[pos] != 'S' || !digit(pos + 1) || !digit(pos + 2) || pos + 3 >= value.length() || value[pos + 3] != 'E' || !digit(pos + 4))
+      return std::string::npos;
+    season = (value[pos + 1] - '0') * 10 + (value[pos + 2] - '0');
+    episode = 0;
+    pos += 4;
+    while (digit(pos))
+      episode = episode * 10 + (value[pos++] - '0');
+    return pos;
+  }
+}
+
 /************************************************************/
 /** Record handling **/
 
@@ -117,21 +133,37 @@ PVR_ERROR Recordings::GetRecordings(bool deleted, kodi::addon::PVRRecordingsResu
   m_lastPlayed.clear();
   m_playCount.clear();
   int recordingCount = 0;
-  tinyxml2::XMLDocument doc;
-  if (m_request.DoMethodRequest("recording.list&filter=all", doc) == tinyxml2::XML_SUCCESS)
+  std::map<std::string, int> names;
+  std::map<std::string, int> seasons;
+  auto addRecording = [&](const tinyxml2::XMLNode* pRecordingNode)
   {
-    tinyxml2::XMLNode* recordingsNode = doc.RootElement()->FirstChildElement("recordings");
-    tinyxml2::XMLNode* pRecordingNode;
-    std::map<std::string, int> names;
-    std::map<std::string, int> seasons;
-    if ((m_settings.m_flattenRecording && m_settings.m_kodiLook) || m_settings.m_separateSeasons)
+    kodi::addon::PVRRecording tag;
+    std::string title;
+    XMLUtils::GetString(pRecordingNode, "name", title);
+    if (UpdatePvrRecording(pRecordingNode, tag, title, names[title] == 1, seasons[title] == std::numeric_limits<int>::max()))
+    {
+      recordingCount++;
+      results.Add(tag);
+    }
+    return true;
+  };
+
+  tinyxml2::XMLError xmlResult;
+  if ((m_settings.m_flattenRecording && m_settings.m_kodiLook) || m_settings.m_separateSeasons)
+  {
+    // names and seasons need a pass over the whole list first
+    tinyxml2::XMLDocument doc;
+    xmlResult = m_request.DoMethodRequest("recording.list&filter=all", doc);
+    if (xmlResult == tinyxml2::XML_SUCCESS)
     {
+      tinyxml2::XMLNode* recordingsNode = doc.RootElement()->FirstChildElement("recordings");
+      tinyxml2::XMLNode* pRecordingNode;
       kodi::addon::PVRRecording mytag;
       int season;
       for (pRecordingNode = recordingsNode->FirstChildElement("recording"); pRecordingNode; pRecordingNode = pRecordingNode->NextSiblingElement())
       {
-        std::string status;
-        XMLUtils::GetString(pRecordingNode, "status", status);
+        std::string_view status;
+        XMLUtils::GetStringView(pRecordingNode, "status", status);
         if (status != "Ready" && status != "Recording")
           continue;
         std::string title;
@@ -157,18 +189,17 @@ PVR_ERROR Recordings::GetRecordings(bool deleted, kodi::addon::PVRRecordingsResu
           seasons[title] = season;
         }
       }
+      for (pRecordingNode = recordingsNode->FirstChildElement("recording"); pRecordingNode; pRecordingNode = pRecordingNode->NextSiblingElement())
+        addRecording(pRecordingNode);
     }
-    for (pRecordingNode = recordingsNode->FirstChildElement("recording"); pRecordingNode; pRecordingNode = pRecordingNode->NextSiblingElement())
-    {
-      kodi::addon::PVRRecording tag;
-      std::string title;
-      XMLUtils::GetString(pRecordingNode, "name", title);
-      if (UpdatePvrRecording(pRecordingNode, tag, title, names[title] == 1, seasons[title] == std::numeric_limits<int>::max()))
-      {
-        recordingCount++;
-        results.Add(tag);
-      }
-    }
+  }
+  else
+  {
+    xmlResult = m_request.DoStreamingMethodRequest("recording.list&filter=all", "recording", addRecording);
+  }
+
+  if (xmlResult == tinyxml2::XML_SUCCESS)
+  {
     m_iRecordingCount = recordingCount;
     // force read disk space
     m_checkedSpace = 0;
@@ -204,11 +235,12 @@ bool Recordings::UpdatePvrRecording(const tinyxml2::XMLNode* pRecordingNode, kod
   std::string buffer;
   tag.SetTitle(title);
 
-  XMLUtils::GetString(pRecordingNode, "start_time_ticks", buffer);
-  tag.SetRecordingTime(stol(buffer));
+  int64_t recordingTime = 0;
+  XMLUtils::GetInt64(pRecordingNode, "start_time_ticks", recordingTime);
+  tag.SetRecordingTime(recordingTime);
 
-  std::string status;
-  XMLUtils::GetString(pRecordingNode, "status", status);
+  std::string_view status;
+  XMLUtils::GetStringView(pRecordingNode, "status", status);
   if (status == "Pending" && tag.GetRecordingTime() > time(nullptr) + m_settings.m_serverTimeOffset)
   {
     // skip timers
@@ -255,7 +287,7 @@ bool Recordings::UpdatePvrRecording(const tinyxml2::XMLNode* pRecordingNode, kod
   }
   else
   {
-    kodi::Log(ADDON_LOG_ERROR, "Unknown status %s", status.c_str());
+    kodi::Log(ADDON_LOG_ERROR, "Unknown status %s", std::string(status).c_str());
     return false;
   }
 
@@ -377,15 +409,15 @@ bool Recordings::UpdatePvrRecording(const tinyxml2::XMLNode* pRecordingNode, kod
     std::string artworkPath;
     if (m_settings.m_backendVersion < 50000)
     {
-      artworkPath = kodi::tools::StringUtils::Format("%s/service?method=recording.artwork&sid=%s&recording_id=%s", m_settings.m_urlBase, m_request.GetSID(), tag.GetRecordingId().c_str());
+      artworkPath = kodi::tools::StringUtils::Format("%s/service?method=recording.artwork&sid=%s&recording_id=%s", m_settings.m_urlBase, m_request.GetSID().c_str(), tag.GetRecordingId().c_str());
       tag.SetThumbnailPath(artworkPath);
-      artworkPath = kodi::tools::StringUtils::Format("%s/service?method=recording.fanart&sid=%s&recording_id=%s", m_settings.m_urlBase, m_request.GetSID(), tag.GetRecordingId().c_str());
+      artworkPath = kodi::tools::StringUtils::Format("%s/service?method=recording.fanart&sid=%s&recording_id=%s", m_settings.m_urlBase, m_request.GetSID().c_str(), tag.GetRecordingId().c_str());
       tag.SetFanartPath(artworkPath);
     }
     else
     {
       if (m_settings.m_sendSidWithMetadata)
-        artworkPath = kodi::tools::StringUtils::Format("%s/service?method=channel.show.artwork&sid=%s&name=%s", m_settings.m_urlBase, m_request.GetSID(), UriEncode(title).c_str());
+        artworkPath = kodi::tools::StringUtils::Format("%s/service?method=channel.show.artwork&sid=%s&name=%s", m_settings.m_urlBase, m_request.GetSID().c_str(), UriEncode(title).c_str());
       else
         artworkPath = kodi::tools::StringUtils::Format("%s/service?method=channel.show.artwork&name=%s", m_settings.m_urlBase, UriEncode(title).c_str());
       tag.SetFanartPath(artworkPath);
@@ -400,13 +432,13 @@ bool Recordings::UpdatePvrRecording(const tinyxml2::XMLNode* pRecordingNode, kod
     tag.SetGenreDescription(buffer);
   }
 
-  std::string significance;
-  XMLUtils::GetString(pRecordingNode, "significance", significance);
-  if (significance.find("Premiere") != std::string::npos)
+  std::string_view significance;
+  XMLUtils::GetStringView(pRecordingNode, "significance", significance);
+  if (significance.find("Premiere") != std::string_view::npos)
   {
     tag.SetFlags(PVR_RECORDING_FLAG_IS_PREMIERE);
   }
-  else if (significance.find("Finale") != std::string::npos)
+  else if (significance.find("Finale") != std::string_view::npos)
   {
     tag.SetFlags(PVR_RECORDING_FLAG_IS_FINALE);
   }
@@ -420,28 +452,32 @@ bool Recordings::ParseNextPVRSubtitle(const tinyxml2::XMLNode *pRecordingNode, k
   bool hasSeasonEpisode = false;
   if (XMLUtils::GetString(pRecordingNode, "subtitle", buffer))
   {
-    std::regex base_regex("S(\\d\\d)E(\\d+) - ?(.+)?");
-    std::smatch base_match;
+    // the whole subtitle must be "SxxEyy - name", the name is optional
+    int season;
+    int episode;
+    size_t pos = ScanSeasonEpisode(buffer, 0, season, episode);
+    if (pos != std::string::npos && buffer.compare(pos, 2, " -") == 0)
+    {
+      pos += 2;
+      if (pos < buffer.length() && buffer[pos] == ' ')
+        pos++;
+      if (buffer.find_first_of("\r\n", pos) != std::string::npos)
+        pos = std::string::npos;
+    }
+    else
+    {
+      pos = std::string::npos;
+    }
     // note NextPVR does not support S0 for specials
-    if (std::regex_match(buffer, base_match, base_regex))
+    if (pos != std::string::npos)
     {
-      if (base_match.size() == 3 || base_match.size() == 4)
+      tag.SetSeriesNumber(season);
+      tag.SetEpisodeNumber(episode);
+      if (m_settings.m_kodiLook)
       {
-
-        std::ssub_match base_sub_match = base_match[1];
-        tag.SetSeriesNumber(std::stoi(base_sub_match.str()));
-        base_sub_match = base_match[2];
-        tag.SetEpisodeNumber(std::stoi(base_sub_match.str()));
-        if (m_settings.m_kodiLook)
-        {
-          if (base_match.size() == 4)
-          {
-            base_sub_match = base_match[3];
-            tag.SetEpisodeName(base_sub_match.str());
-          }
-        }
-        hasSeasonEpisode = true;
+        tag.SetEpisodeName(buffer.substr(pos));
       }
+      hasSeasonEpisode = true;
     }
     else if (m_settings.m_kodiLook)
     {
@@ -454,21 +490,21 @@ bool Recordings::ParseNextPVRSubtitle(const tinyxml2::XMLNode *pRecordingNode, k
     std::string recordingFile;
     if (XMLUtils::GetString(pRecordingNode, "file", recordingFile))
     {
-      std::regex base_regex("S(\\d\\d)E(\\d+)");
-      std::smatch base_match;
-      if (std::regex_search(recordingFile, base_match, base_regex))
+      // first SxxEyy anywhere in the file name
+      int season;
+      int episode;
+      for (size_t pos = recordingFile.find('S'); pos != std::string::npos; pos = recordingFile.find('S', pos + 1))
       {
-        if (base_match.size() == 3)
+        if (ScanSeasonEpisode(recordingFile, pos, season, episode) != std::string::npos)
         {
-          std::ssub_match base_sub_match = base_match[1];
-          tag.SetSeriesNumber(std::stoi(base_sub_match.str()));
-          base_sub_match = base_match[2];
-          tag.SetEpisodeNumber(std::stoi(base_sub_match.str()));
+          tag.SetSeriesNumber(season);
+          tag.SetEpisodeNumber(episode);
           if (!m_settings.m_kodiLook)
           {
             tag.SetTitle(kodi::tools::StringUtils::Format("S%2.2dE%2.2d - %s", tag.GetSeriesNumber(), tag.GetEpisodeNumber(), buffer.c_str()));
           }
           hasSeasonEpisode = true;
+          break;
         }
       }
     }
@@ -608,12 +644,12 @@ PVR_ERROR Recordings::GetRecordingEdl(const kodi::addon::PVRRecording& recording
     for (pCommercialNode = commercialsNode->FirstChildElement("commercial"); pCommercialNode; pCommercialNode = pCommercialNode->NextSiblingElement())
     {
       kodi::addon::PVREDLEntry entry;
-      std::string buffer;
-      XMLUtils::GetString(pCommercialNode, "start", buffer);
-      entry.SetStart(std::stoll(buffer) * 1000);
-      buffer.clear();
-      XMLUtils::GetString(pCommercialNode, "end", buffer);
-      entry.SetEnd(std::stoll(buffer) * 1000);
+      int64_t value = 0;
+      XMLUtils::GetInt64(pCommercialNode, "start", value);
+      entry.SetStart(value * 1000);
+      value = 0;
+      XMLUtils::GetInt64(pCommercialNode, "end", value);
+      entry.SetEnd(value * 1000);
       entry.SetType(PVR_EDL_TYPE_COMBREAK);
       edl.emplace_back(entry);
     }
@@ -14,6 +14,7 @@
 
 #include <kodi/General.h>
 #include <kodi/tools/StringUtils.h>
+#include <algorithm>
 
 using namespace NextPVR;
 using namespace NextPVR::utilities;
@@ -53,6 +54,8 @@ void Settings::ReadFromAddon()
 
   m_timeoutWOL = kodi::GetSettingInt("woltimeout", 20);
 
+  m_maxConcurrentRequests = kodi::GetSettingInt("maxrequests", 4);
+
   m_downloadGuideArtwork = kodi::GetSettingBoolean("guideartwork" ,DEFAULT_GUIDE_ARTWORK);
 
   m_remoteAccess = kodi::GetSettingBoolean("remoteaccess", false);
@@ -71,6 +74,18 @@ void Settings::ReadFromAddon()
 
   m_chunkRecording = kodi::GetSettingInt("chunkrecording", 32);
 
+  m_timeshiftMinBuffer = kodi::GetSettingInt("tsbminbuffer", 1);
+
+  m_timeshiftMaxBuffer = std::max(m_timeshiftMinBuffer, kodi::GetSettingInt("tsbmaxbuffer", 16));
+
+  m_timeshiftMaxWindow = kodi::GetSettingInt("tsbmaxwindow", 32);
+
+  m_timeshiftHistorySeconds = kodi::GetSettingInt("tsbhistory", 10);
+
+  m_timeshiftSpill = kodi::GetSettingBoolean("tsbspill", false);
+
+  m_timeshiftSpillSize = kodi::GetSettingInt("tsbspillsize", 1024);
+
   m_ignorePadding = kodi::GetSettingBoolean("ignorepadding", true);
 
   m_resolution = kodi::GetSettingString("resolution",  "720");
@@ -287,6 +302,8 @@ ADDON_STATUS Settings::SetValue(const std::string& settingName, const kodi::CSet
     return SetSetting<bool, ADDON_STATUS>(settingName, settingValue, m_kodiLook, ADDON_STATUS_NEED_SETTINGS, ADDON_STATUS_OK);
   else if (settingName == "genrestring")
     return SetSetting<bool, ADDON_STATUS>(settingName, settingValue, m_genreString, ADDON_STATUS_NEED_SETTINGS, ADDON_STATUS_OK);
+  else if (settingName == "maxrequests")
+    return SetSetting<int, ADDON_STATUS>(settingName, settingValue, m_maxConcurrentRequests, ADDON_STATUS_OK, ADDON_STATUS_OK);
   else if (settingName == "host_mac")
     return SetStringSetting<ADDON_STATUS>(settingName, settingValue, m_hostMACAddress, ADDON_STATUS_OK, ADDON_STATUS_OK);
   else if (settingName == "livestreamingmethod" && m_backendVersion < 50000)
@@ -301,6 +318,18 @@ ADDON_STATUS Settings::SetValue(const std::string& settingName, const kodi::CSet
     return SetSetting<int, ADDON_STATUS>(settingName, settingValue, m_liveChunkSize, ADDON_STATUS_OK, ADDON_STATUS_OK);
   else if (settingName == "chuckrecordings")
     return SetSetting<int, ADDON_STATUS>(settingName, settingValue, m_chunkRecording, ADDON_STATUS_OK, ADDON_STATUS_OK);
+  else if (settingName == "tsbminbuffer")
+    return SetSetting<int, ADDON_STATUS>(settingName, settingValue, m_timeshiftMinBuffer, ADDON_STATUS_OK, ADDON_STATUS_OK);
+  else if (settingName == "tsbmaxbuffer")
+    return SetSetting<int, ADDON_STATUS>(settingName, settingValue, m_timeshiftMaxBuffer, ADDON_STATUS_OK, ADDON_STATUS_OK);
+  else if (settingName == "tsbmaxwindow")
+    return SetSetting<int, ADDON_STATUS>(settingName, settingValue, m_timeshiftMaxWindow, ADDON_STATUS_OK, ADDON_STATUS_OK);
+  else if (settingName == "tsbhistory")
+    return SetSetting<int, ADDON_STATUS>(settingName, settingValue, m_timeshiftHistorySeconds, ADDON_STATUS_OK, ADDON_STATUS_OK);
+  else if (settingName == "tsbspill")
+    return SetSetting<bool, ADDON_STATUS>(settingName, settingValue, m_timeshiftSpill, ADDON_STATUS_OK, ADDON_STATUS_OK);
+  else if (settingName == "tsbspillsize")
+    return SetSetting<int, ADDON_STATUS>(settingName, settingValue, m_timeshiftSpillSize, ADDON_STATUS_OK, ADDON_STATUS_OK);
   else if (settingName == "resolution")
     return SetStringSetting<ADDON_STATUS>(settingName, settingValue, m_resolution, ADDON_STATUS_OK, ADDON_STATUS_OK);
   else if (settingName == "ffmpegdirect")
@@ -82,6 +82,7 @@ namespace NextPVR
     bool m_enableWOL = false;
     int m_timeoutWOL = 0;
     bool m_connectionConfirmed = false;
+    int m_maxConcurrentRequests = 4;
     bool m_backendResume = true;
 
     //General
@@ -116,6 +117,12 @@ namespace NextPVR
     int m_timeshiftBufferSeconds = 1200;
     eStreamingMethod m_liveStreamingMethod = RealTime;
     int m_liveChunkSize = 64;
+    int m_timeshiftMinBuffer = 1;
+    int m_timeshiftMaxBuffer = 16;
+    int m_timeshiftMaxWindow = 32;
+    int m_timeshiftHistorySeconds = 10;
+    bool m_timeshiftSpill = false;
+    int m_timeshiftSpillSize = 1024;
     //int m_prebuffer;
     int m_prebuffer = 8;
     int m_prebuffer5 = 0;
@@ -67,20 +67,35 @@ bool Socket::setHostname ( const std::string& host )
   return true;
 }
 
-bool Socket::read_ready()
+bool Socket::read_ready(int milliseconds)
 {
-  fd_set fdset;
-
-  FD_ZERO(&fdset);
-  FD_SET(_sd, &fdset);
+  return wait_readable(milliseconds) > 0;
+}
 
-  struct timeval tv = { 1, 0 };
-  //  tv.tv_sec = 1;
+int Socket::wait_readable(int milliseconds) const
+{
+  if (!is_valid())
+    return SOCKET_ERROR;
 
-  int retVal = select(_sd+1, &fdset, nullptr, nullptr, &tv);
-  if (retVal > 0)
-    return true;
-  return false;
+#if defined(TARGET_WINDOWS)
+  WSAPOLLFD pfd = { _sd, POLLRDNORM, 0 };
+  int retVal = WSAPoll(&pfd, 1, milliseconds);
+#else
+  struct pollfd pfd = { _sd, POLLIN, 0 };
+  int retVal;
+  do
+  {
+    retVal = poll(&pfd, 1, milliseconds);
+  } while (retVal < 0 && errno == EINTR);
+#endif
+  if (retVal < 0)
+    return SOCKET_ERROR;
+  if (retVal == 0)
+    return 0;
+  // a hang up is reported as readable, the next receive sees the end of stream
+  if (pfd.revents & POLLNVAL)
+    return SOCKET_ERROR;
+  return 1;
 }
 
 
@@ -365,6 +380,75 @@ int Socket::receive ( char* data, const unsigned int buffersize, const unsigned
 }
 
 
+int Socket::receive ( char* first, const unsigned int firstsize, char* second, const unsigned int secondsize, bool waitall ) const
+{
+  const unsigned int total = firstsize + secondsize;
+  unsigned int receivedsize = 0;
+
+  if ( !is_valid() )
+  {
+    return 0;
+  }
+
+  while ( receivedsize < total )
+  {
+    // skip whatever part of the two buffers is already filled
+    char* base[2] = { first, second };
+    unsigned int length[2] = { firstsize, secondsize };
+    int index = receivedsize < firstsize ? 0 : 1;
+    unsigned int offset = index == 0 ? receivedsize : receivedsize - firstsize;
+    int count = 0;
+#if defined(TARGET_WINDOWS)
+    WSABUF buffers[2];
+    for (int i = index; i < 2; i++)
+    {
+      buffers[count].buf = base[i] + (i == index ? offset : 0);
+      buffers[count].len = length[i] - (i == index ? offset : 0);
+      count++;
+    }
+    DWORD received = 0;
+    DWORD flags = 0;
+    int status = ::WSARecv(_sd, buffers, count, &received, &flags, nullptr, nullptr) == 0 ? (int)received : SOCKET_ERROR;
+#else
+    struct iovec buffers[2];
+    for (int i = index; i < 2; i++)
+    {
+      buffers[count].iov_base = base[i] + (i == index ? offset : 0);
+      buffers[count].iov_len = length[i] - (i == index ? offset : 0);
+      count++;
+    }
+    int status = ::readv(_sd, buffers, count);
+#endif
+
+    if ( status == SOCKET_ERROR )
+    {
+      int lasterror = getLastError();
+#if defined(TARGET_WINDOWS)
+      if ( lasterror != WSAEWOULDBLOCK)
+#else
+      if ( lasterror != EAGAIN )
+#endif
+      {
+        errormessage( lasterror, "Socket::receive" );
+      }
+      else
+      {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        continue;
+      }
+      return status;
+    }
+    if ( status == 0 )
+      break;
+
+    receivedsize += status;
+    if ( !waitall )
+      break;
+  }
+
+  return receivedsize;
+}
+
 int Socket::recvfrom ( char* data, const int buffersize, struct sockaddr* from, socklen_t* fromlen) const
 {
   int status = ::recvfrom(_sd, data, buffersize, 0, from, fromlen);
@@ -39,7 +39,10 @@
   #include <arpa/inet.h>     /* for inet_pton */
   #include <netdb.h>         /* for gethostbyname */
   #include <netinet/in.h>    /* for htons */
+  #include <netinet/tcp.h>   /* for TCP_NODELAY */
   #include <unistd.h>        /* for read, write, close */
+  #include <sys/uio.h>       /* for readv */
+  #include <poll.h>          /* for poll */
   #include <errno.h>
   #include <fcntl.h>
 
@@ -254,6 +257,18 @@ class Socket
      */
     int receive ( char* data, const unsigned int buffersize, const unsigned int minpacketsize ) const;
 
+    /*!
+     * Socket scatter receive function, fills 'first' and then 'second'
+     *
+     * \param first    Pointer to the first character array
+     * \param firstsize    Size of the 'first' buffer
+     * \param second    Pointer to the second character array, may be nullptr when secondsize is 0
+     * \param secondsize    Size of the 'second' buffer
+     * \param waitall    Keep reading until both buffers are full, otherwise return after the first successful read
+     * \return    Number of bytes received (firstsize + secondsize with waitall, unless the connection closed) or SOCKET_ERROR
+     */
+    int receive ( char* first, const unsigned int firstsize, char* second, const unsigned int secondsize, bool waitall = true ) const;
+
     /*!
      * Socket recvfrom function
      *
@@ -272,7 +287,15 @@ class Socket
     bool SetSocketOption(int level, int option, char* setting, int value);
     int BroadcastSendTo(int port, const char* msg, int len);
     int BroadcastReceiveFrom(char* payload, int payloadLength);
-    bool read_ready();
+    bool read_ready(int milliseconds = 1000);
+
+    /*!
+     * Wait until the socket is readable, without spinning
+     *
+     * \param milliseconds    How long to wait, 0 only checks
+     * \return    1 when data (or end of stream) can be read, 0 on timeout, SOCKET_ERROR on failure
+     */
+    int wait_readable(int milliseconds) const;
 
   private:
 
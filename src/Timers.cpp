@@ -113,10 +113,11 @@ PVR_ERROR Timers::GetTimers(kodi::addon::PVRTimersResultSet& results)
       }
       else
       {
-        if (XMLUtils::GetString(pRulesNode, "StartTimeTicks", buffer))
-          tag.SetStartTime(stoll(buffer));
-        if (XMLUtils::GetString(pRulesNode, "EndTimeTicks", buffer))
-          tag.SetEndTime(stoll(buffer));
+        int64_t ticks;
+        if (XMLUtils::GetInt64(pRulesNode, "StartTimeTicks", ticks))
+          tag.SetStartTime(ticks);
+        if (XMLUtils::GetInt64(pRulesNode, "EndTimeTicks", ticks))
+          tag.SetEndTime(ticks);
         if (recordingType == 7)
         {
           tag.SetEPGSearchString(TYPE_7_TITLE);
@@ -281,13 +282,12 @@ bool Timers::UpdatePvrTimer(tinyxml2::XMLNode* pRecordingNode, kodi::addon::PVRT
   XMLUtils::GetString(pRecordingNode, "desc", buffer);
   tag.SetSummary(buffer);
   // start/end time
-  buffer.clear();
-  XMLUtils::GetString(pRecordingNode, "start_time_ticks", buffer);
-  buffer.resize(10);
-  tag.SetStartTime(std::stoll(buffer));
-  buffer.clear();
-  XMLUtils::GetString(pRecordingNode, "duration_seconds", buffer);
-  tag.SetEndTime(tag.GetStartTime() + std::stoll(buffer));
+  time_t startTime = 0;
+  XMLUtils::GetEpochSeconds(pRecordingNode, "start_time_ticks", startTime);
+  tag.SetStartTime(startTime);
+  int64_t duration = 0;
+  XMLUtils::GetInt64(pRecordingNode, "duration_seconds", duration);
+  tag.SetEndTime(tag.GetStartTime() + duration);
 
   if (tag.GetTimerType() == TIMER_ONCE_EPG || tag.GetTimerType() == TIMER_ONCE_EPG_CHILD)
   {
@@ -306,8 +306,8 @@ bool Timers::UpdatePvrTimer(tinyxml2::XMLNode* pRecordingNode, kodi::addon::PVRT
 
   tag.SetState(PVR_TIMER_STATE_SCHEDULED);
 
-  std::string status;
-  if (XMLUtils::GetString(pRecordingNode, "status", status))
+  std::string_view status;
+  if (XMLUtils::GetStringView(pRecordingNode, "status", status))
   {
     if (status == "Recording" || (status == "Pending" && tag.GetStartTime() < time(nullptr) + m_settings.m_serverTimeOffset))
     {
@@ -841,10 +841,9 @@ int Timers::GetEPGOidForTimer(const kodi::addon::PVRTimer& timer)
     tinyxml2::XMLNode* listingsNode = doc.RootElement()->FirstChildElement("listings");
     for (tinyxml2::XMLNode* pListingNode = listingsNode->FirstChildElement("l"); pListingNode; pListingNode = pListingNode->NextSiblingElement())
     {
-      std::string endTime;
-      XMLUtils::GetString(pListingNode, "end", endTime);
-      endTime.resize(10);
-      if (atoi(endTime.c_str()) == timer.GetEPGUid())
+      time_t endTime = 0;
+      XMLUtils::GetEpochSeconds(pListingNode, "end", endTime);
+      if (endTime == timer.GetEPGUid())
       {
         epgOid = XMLUtils::GetIntValue(pListingNode, "id");
         break;
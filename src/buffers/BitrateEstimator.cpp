@@ -0,0 +1,49 @@
+/*
+ *  Copyright (C) 2020 Team Kodi
+ *  https://kodi.tv
+ *
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *  See LICENSE.md for more information.
+ */
+
+#include "BitrateEstimator.h"
+
+using namespace timeshift;
+
+void BitrateEstimator::Reset()
+{
+  m_samples.clear();
+  m_average = 0;
+  m_bytesPerSecond.store(0);
+}
+
+bool BitrateEstimator::AddSample(int64_t length)
+{
+  const Clock::time_point now = Clock::now();
+
+  // the file only grows, anything else is a new file
+  if (!m_samples.empty() && length < m_samples.back().length)
+    m_samples.clear();
+  // several blocks arrive for each change in length, the first one dates it
+  if (!m_samples.empty() && length == m_samples.back().length)
+    return false;
+  m_samples.push_back({length, now});
+
+  // drop samples that have left the window, keeping enough for a rate
+  while (m_samples.size() > 2 && now - m_samples[1].time >= m_window)
+    m_samples.pop_front();
+
+  const Clock::duration span = now - m_samples.front().time;
+  if (m_samples.size() < 2 || span < m_minSpan)
+    return false;
+
+  const double seconds = std::chrono::duration<double>(span).count();
+  const double rate = (length - m_samples.front().length) / seconds;
+  m_average = m_average == 0 ? rate : m_average + m_weight * (rate - m_average);
+
+  const int bytesPerSecond = static_cast<int>(m_average + 0.5);
+  if (bytesPerSecond == m_bytesPerSecond.load())
+    return false;
+  m_bytesPerSecond.store(bytesPerSecond);
+  return true;
+}
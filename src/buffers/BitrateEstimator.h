@@ -0,0 +1,63 @@
+/*
+ *  Copyright (C) 2020 Team Kodi
+ *  https://kodi.tv
+ *
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *  See LICENSE.md for more information.
+ */
+
+#pragma once
+
+#include <kodi/AddonBase.h>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <stdint.h>
+
+namespace timeshift {
+
+  /**
+   * Estimates the stream bitrate from the growth of the backend timeshift file.
+   *
+   * Samples of (file length, arrival time) are taken as blocks come in. The rate
+   * over a sliding window of samples is smoothed with an exponentially weighted
+   * moving average. Samples are only added from one thread, the estimate can be
+   * read from any.
+   */
+  class ATTRIBUTE_HIDDEN BitrateEstimator
+  {
+  public:
+    BitrateEstimator(int windowSeconds = 10, int minSpanMs = 1000, double weight = 0.25)
+      : m_window(std::chrono::seconds(windowSeconds)), m_minSpan(std::chrono::milliseconds(minSpanMs)),
+        m_weight(weight), m_average(0), m_bytesPerSecond(0) {}
+
+    void Reset();
+
+    /**
+     * Record the file length seen now.
+     * @return true when the estimate changed
+     */
+    bool AddSample(int64_t length);
+
+    /**
+     * The current estimate, 0 until enough samples are in.
+     */
+    int BytesPerSecond() const { return m_bytesPerSecond.load(); }
+
+  private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Sample
+    {
+      int64_t length;
+      Clock::time_point time;
+    };
+
+    const Clock::duration m_window;
+    const Clock::duration m_minSpan;
+    const double m_weight;
+    std::deque<Sample> m_samples;
+    double m_average;
+    std::atomic<int> m_bytesPerSecond;
+  };
+}
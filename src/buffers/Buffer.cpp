@@ -95,6 +95,7 @@ void Buffer::LeaseWorker(void)
       GetStreamInfo();
       if (complete) m_complete = true;
     }
+    Prefetch();
     std::this_thread::sleep_for(std::chrono::milliseconds(1000));
   }
 }
@@ -46,7 +46,7 @@ namespace timeshift {
   public:
     Buffer() :
       m_active(false), m_startTime(0),
-      m_readTimeout(DEFAULT_READ_TIMEOUT) { kodi::Log(ADDON_LOG_INFO, "Buffer created!"); };
+      m_readTimeout(DEFAULT_READ_TIMEOUT), m_channel_id(0) { kodi::Log(ADDON_LOG_INFO, "Buffer created!"); };
     virtual ~Buffer();
 
     NextPVR::Settings& m_settings = NextPVR::Settings::GetInstance();
@@ -175,6 +175,12 @@ namespace timeshift {
     std::thread m_leaseThread;
     void LeaseWorker();
     virtual bool GetStreamInfo() {return true;}
+
+    /**
+     * Called from the lease thread after the stream info is refreshed, lets a
+     * buffer get the next part of the stream ready before it is read
+     */
+    virtual void Prefetch() {}
     bool m_complete;
     mutable std::mutex m_mutex;
 
@@ -0,0 +1,94 @@
+/*
+ *  Copyright (C) 2020 Team Kodi
+ *  https://kodi.tv
+ *
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *  See LICENSE.md for more information.
+ */
+
+#pragma once
+
+#include <kodi/General.h>
+#include <atomic>
+#include <stdint.h>
+#include <string>
+
+//
+// Per block tracing for the timeshift buffers. Left out of normal builds so the
+// hot paths do not format log lines nobody reads, enable it here when debugging.
+//
+//#define BUFFER_TRACE
+
+#if defined(BUFFER_TRACE)
+#define TRACE_BUFFER(...) kodi::Log(ADDON_LOG_DEBUG, __VA_ARGS__)
+#else
+#define TRACE_BUFFER(...) do {} while (0)
+#endif
+
+namespace timeshift {
+
+  /**
+   * Counters kept by CircularBuffer in every build, logged when a session closes.
+   */
+  struct ATTRIBUTE_HIDDEN RingStats
+  {
+    std::atomic<uint64_t> bytesIn{0};
+    std::atomic<uint64_t> bytesOut{0};
+    std::atomic<uint64_t> wraps{0};
+    std::atomic<uint64_t> adjusts{0};
+    std::atomic<uint64_t> rejected{0};
+
+    void Clear()
+    {
+      bytesIn.store(0, std::memory_order_relaxed);
+      bytesOut.store(0, std::memory_order_relaxed);
+      wraps.store(0, std::memory_order_relaxed);
+      adjusts.store(0, std::memory_order_relaxed);
+      rejected.store(0, std::memory_order_relaxed);
+    }
+
+    static void Add(std::atomic<uint64_t>& counter, uint64_t value = 1)
+    {
+      counter.fetch_add(value, std::memory_order_relaxed);
+    }
+  };
+
+  /**
+   * Distribution of wait times in milliseconds, in power of four buckets
+   * (<1, <4, <16, <64, <256, <1024, <4096, longer).
+   */
+  struct ATTRIBUTE_HIDDEN LatencyHistogram
+  {
+    static const int BUCKETS = 8;
+    std::atomic<uint64_t> buckets[BUCKETS] = {};
+
+    void Add(int64_t milliseconds)
+    {
+      int bucket = 0;
+      for (int64_t limit = 1; bucket < BUCKETS - 1 && milliseconds >= limit; limit <<= 2)
+        bucket++;
+      buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void Clear()
+    {
+      for (auto& bucket : buckets)
+        bucket.store(0, std::memory_order_relaxed);
+    }
+
+    std::string ToString() const
+    {
+      static const char* labels[BUCKETS] = { "<1", "<4", "<16", "<64", "<256", "<1024", "<4096", ">=4096" };
+      std::string result;
+      for (int i = 0; i < BUCKETS; i++)
+      {
+        result += labels[i];
+        result += "ms:";
+        result += std::to_string(buckets[i].load(std::memory_order_relaxed));
+        if (i < BUCKETS - 1)
+          result += ' ';
+      }
+      return result;
+    }
+  };
+}
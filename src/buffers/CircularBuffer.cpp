@@ -8,70 +8,94 @@
  */
 
 //
-//  Dead simple circular buffer
+//  Single producer / single consumer circular buffer
 //
 
 #include "CircularBuffer.h"
+#include <algorithm>
 
 using namespace timeshift;
 
 
 bool CircularBuffer::WriteBytes(const byte *buffer, int length)
 {
-  if (length > m_iSize - m_iBytes)
+  byte *first, *second;
+  int firstLength, secondLength;
+  if (length > WritableRegions(&first, &firstLength, &second, &secondLength))
   {
-    kodi::Log(ADDON_LOG_DEBUG, "WriteBytes: returning false %d [%d] [%d] [%d]", length, m_iSize, m_iBytes, m_iSize - m_iBytes);
+    TRACE_BUFFER("WriteBytes: returning false %d [%d] [%d]", length, m_iSize, BytesAvailable());
+    RingStats::Add(m_stats.rejected);
     return false;
   }
-  if (length + m_iWritePos > m_iSize)
+  if (length > firstLength)
   {
-    unsigned int chunk = m_iSize - m_iWritePos;
-    memcpy(m_cBuffer + m_iWritePos, buffer, chunk);
-    memcpy(m_cBuffer, buffer + chunk, length - chunk);
-    m_iWritePos = length - chunk;
+    memcpy(first, buffer, firstLength);
+    memcpy(second, buffer + firstLength, length - firstLength);
   }
   else
   {
-    memcpy(m_cBuffer + m_iWritePos, buffer, length);
-    m_iWritePos += length;
+    memcpy(first, buffer, length);
   }
-  if (m_iWritePos == m_iSize)
-    m_iWritePos = 0;
-  m_iBytes += length;
-  kodi::Log(ADDON_LOG_DEBUG, "WriteBytes: wrote %d bytes, returning true. [%d] [%d] [%d]", length, m_iSize, m_iBytes, m_iSize - m_iBytes);
+  return CommitWrite(length);
+}
+
+int CircularBuffer::WritableRegions(byte **first, int *firstLength, byte **second, int *secondLength)
+{
+  const uint64_t head = m_head.load(std::memory_order_relaxed);
+  const uint64_t tail = m_tail.load(std::memory_order_acquire);
+  const int free = m_iSize - m_iRewind - static_cast<int>(head - tail);
+  const int writePos = static_cast<int>(head % m_iSize);
+  *first = m_cBuffer + writePos;
+  *firstLength = std::min(free, m_iSize - writePos);
+  *second = m_cBuffer;
+  *secondLength = free - *firstLength;
+  return free;
+}
+
+bool CircularBuffer::CommitWrite(int length)
+{
+  const uint64_t head = m_head.load(std::memory_order_relaxed);
+  if (length > m_iSize - m_iRewind - static_cast<int>(head - m_tail.load(std::memory_order_acquire)))
+  {
+    RingStats::Add(m_stats.rejected);
+    return false;
+  }
+  if (static_cast<int>(head % m_iSize) + length > m_iSize)
+    RingStats::Add(m_stats.wraps);
+  // publish the data to the consumer
+  m_head.store(head + length, std::memory_order_release);
+  RingStats::Add(m_stats.bytesIn, length);
+  TRACE_BUFFER("CommitWrite: wrote %d bytes [%d]", length, BytesAvailable());
   return true;
 }
 
 int  CircularBuffer::ReadBytes(byte *buffer, int length)
 {
-  if (length + m_iReadPos > m_iSize)
+  const uint64_t tail = m_tail.load(std::memory_order_relaxed);
+  const uint64_t head = m_head.load(std::memory_order_acquire);
+  length = std::min(length, static_cast<int>(head - tail));
+  const int readPos = static_cast<int>(tail % m_iSize);
+  if (length + readPos > m_iSize)
   {
-    unsigned int chunk = m_iSize - m_iReadPos;
-    memcpy(buffer, m_cBuffer + m_iReadPos, chunk);
+    int chunk = m_iSize - readPos;
+    memcpy(buffer, m_cBuffer + readPos, chunk);
     memcpy(buffer + chunk, m_cBuffer, length - chunk);
-    m_iReadPos = length - chunk;
   }
   else
   {
-    memcpy(buffer, m_cBuffer + m_iReadPos, length);
-    m_iReadPos += length;
+    memcpy(buffer, m_cBuffer + readPos, length);
   }
-  if (m_iReadPos == m_iSize)
-    m_iReadPos = 0;
-  m_iBytes -= length;
-  kodi::Log(ADDON_LOG_DEBUG, "ReadBytes: returning %d\n", length);
+  // hand the space back to the producer
+  m_tail.store(tail + length, std::memory_order_release);
+  RingStats::Add(m_stats.bytesOut, length);
+  TRACE_BUFFER("ReadBytes: returning %d", length);
   return length;
 }
 
 int CircularBuffer::AdjustBytes(int delta)
 {
-  kodi::Log(ADDON_LOG_DEBUG, "AdjustBytes(%d): before: %d [%d]\n", delta, m_iReadPos, m_iBytes);
-  m_iReadPos += delta;
-  if (m_iReadPos < 0)
-    m_iReadPos += m_iSize;
-  if (m_iReadPos > m_iSize)
-    m_iReadPos -= m_iSize;
-  m_iBytes -= delta;
-  kodi::Log(ADDON_LOG_DEBUG, "AdjustBytes(%d): after: %d [%d]\n", delta, m_iReadPos, m_iBytes);
-  return m_iBytes;
+  m_tail.fetch_add(static_cast<int64_t>(delta), std::memory_order_acq_rel);
+  RingStats::Add(m_stats.adjusts);
+  TRACE_BUFFER("AdjustBytes(%d): after: %d", delta, BytesAvailable());
+  return BytesAvailable();
 }
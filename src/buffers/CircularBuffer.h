@@ -10,32 +10,104 @@
 #pragma once
 
 //
-// Dead simple circular buffer
+// Single producer / single consumer circular buffer
+//
+// The producer only moves the head and the consumer only moves the tail, so
+// neither side needs a lock to copy data in or out. Both counters run freely
+// and are reduced modulo the size when used as positions.
 //
 
 #include "Buffer.h"
+#include "BufferTrace.h"
+#include <algorithm>
+#include <atomic>
 
 namespace timeshift {
 
   class ATTRIBUTE_HIDDEN CircularBuffer {
   public:
-    CircularBuffer(int size) : m_iBytes(0), m_iReadPos(0), m_iWritePos(0), m_iSize(size) { m_cBuffer = new byte[m_iSize]; }
+    /**
+     * @param rewind bytes behind the tail that the producer leaves alone, so
+     * the consumer can step back that far with AdjustBytes()
+     */
+    CircularBuffer(int size, int rewind = 0) : m_iSize(size), m_iRewind(rewind), m_base(0), m_head(0), m_tail(0) { m_cBuffer = new byte[m_iSize]; }
     ~CircularBuffer() { delete[] m_cBuffer; }
 
-    void Reset() { m_iBytes = m_iReadPos = m_iWritePos = 0; }
+    /**
+     * Replace the storage, discarding any data. Only call while neither side is running.
+     */
+    void Resize(int size, int rewind)
+    {
+      if (size != m_iSize)
+      {
+        delete[] m_cBuffer;
+        m_iSize = size;
+        m_cBuffer = new byte[m_iSize];
+      }
+      m_iRewind = rewind;
+      m_base = 0;
+      m_head.store(0);
+      m_tail.store(0);
+    }
+
+    /**
+     * Discard all buffered data and the history behind it (consumer side).
+     */
+    void Reset()
+    {
+      m_base = m_head.load(std::memory_order_acquire);
+      m_tail.store(m_base, std::memory_order_release);
+    }
 
     bool WriteBytes(const byte *, int);
+
+    /**
+     * Producer side zero copy write. Returns the free space as up to two
+     * regions (the second one is used when the free space wraps), fill them
+     * and then publish the bytes with CommitWrite().
+     * @return the total free space
+     */
+    int WritableRegions(byte **first, int *firstLength, byte **second, int *secondLength);
+    bool CommitWrite(int length);
     int ReadBytes(byte *, int);
-    int BytesFree() { return m_iSize - m_iBytes; }
-    int BytesAvailable() { return m_iBytes; }
+    int BytesFree() const { return m_iSize - m_iRewind - BytesAvailable(); }
+    int BytesAvailable() const
+    {
+      return static_cast<int>(m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire));
+    }
     int AdjustBytes(int);
-    int Size() { return m_iSize; }
+
+    /**
+     * Already read bytes behind the tail that are still intact, the consumer
+     * can go back this far with a negative AdjustBytes() (consumer side).
+     */
+    int BytesHistory() const
+    {
+      return static_cast<int>(std::min<uint64_t>(m_tail.load(std::memory_order_relaxed) - m_base, m_iRewind));
+    }
+    int Size() const { return m_iSize - m_iRewind; }
+    RingStats& Stats() { return m_stats; }
 
   private:
     byte     *m_cBuffer;
-    int32_t  m_iReadPos;
-    int32_t  m_iWritePos;
-    int32_t  m_iSize;
-    int32_t  m_iBytes;
+    int32_t   m_iSize;
+    int32_t   m_iRewind;
+
+    /**
+     * Oldest position that is still part of the current stream, moved on by Reset()
+     */
+    uint64_t  m_base;
+
+    /**
+     * Total bytes written, only stored by the producer
+     */
+    alignas(64) std::atomic<uint64_t> m_head;
+
+    /**
+     * Total bytes consumed, only stored by the consumer
+     */
+    alignas(64) std::atomic<uint64_t> m_tail;
+
+    alignas(64) RingStats m_stats;
   };
 }
@@ -27,6 +27,8 @@ bool ClientTimeShift::Open(const std::string inputUrl)
   m_rollingStartSeconds = 0;
   m_bytesPerSecond = 0;
   m_complete = false;
+  m_index.Reset();
+  m_readBase = 0;
 
   m_prebuffer = m_settings.m_prebuffer5;
 
@@ -110,7 +112,7 @@ void ClientTimeShift::Resume()
   ClientTimeShift::GetStreamInfo();
   if (m_stream_duration > m_settings.m_timeshiftBufferSeconds)
   {
-    int64_t startSlipBuffer = m_stream_length - (m_settings.m_timeshiftBufferSeconds * m_stream_length / m_stream_duration);
+    int64_t startSlipBuffer = SlipBufferStart();
     kodi::Log(ADDON_LOG_DEBUG, "%s:%d: %lld %lld %lld", __FUNCTION__, __LINE__, startSlipBuffer, m_streamPosition, m_stream_length.load());
     if (m_streamPosition < startSlipBuffer)
     {
@@ -123,6 +125,15 @@ void ClientTimeShift::Resume()
   }
 }
 
+int64_t ClientTimeShift::SlipBufferStart()
+{
+  // the time the backend keeps is exact, the bytes it takes are only known where they have been read
+  int64_t indexed = m_index.OffsetAt(static_cast<double>(m_stream_duration - m_settings.m_timeshiftBufferSeconds));
+  if (indexed >= 0)
+    return indexed;
+  return m_stream_length - (m_settings.m_timeshiftBufferSeconds * m_stream_length / m_stream_duration);
+}
+
 void ClientTimeShift::StreamStop()
 {
   if (!m_request.DoActionRequest("channel.stream.stop"))
@@ -140,12 +151,14 @@ int64_t ClientTimeShift::Seek(int64_t position, int whence)
 
   if (m_stream_duration > m_settings.m_timeshiftBufferSeconds)
   {
-    int64_t startSlipBuffer = m_stream_length - (m_settings.m_timeshiftBufferSeconds * m_stream_length/m_stream_duration);
+    int64_t startSlipBuffer = SlipBufferStart();
     kodi::Log(ADDON_LOG_DEBUG, "%s:%d: %lld %lld %lld", __FUNCTION__, __LINE__, startSlipBuffer, position, m_stream_length.load());
     if (position < startSlipBuffer)
       position = startSlipBuffer;
   }
 
+  position = m_index.Align(position);
+
   kodi::Log(ADDON_LOG_DEBUG, "%s:%d: %lld %d %lld %d", __FUNCTION__, __LINE__, position, whence, m_stream_duration.load(), m_isPaused);
   if ( m_isPaused == true)
   {
@@ -158,6 +171,7 @@ int64_t ClientTimeShift::Seek(int64_t position, int whence)
     kodi::Log(ADDON_LOG_ERROR, "Could not open file on seek");
     return  -1;
   }
+  m_readBase = position;
   return position;
 }
 
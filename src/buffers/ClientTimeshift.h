@@ -10,6 +10,7 @@
 #pragma once
 
 #include "RollingFile.h"
+#include "PcrIndex.h"
 #include <thread>
 #include <list>
 
@@ -28,6 +29,21 @@ namespace timeshift {
 	 */
 	std::string m_sourceURL;
 
+    /**
+     * PCR times of what has been read, for finding the start of the slip buffer
+     */
+    PcrIndex m_index;
+
+    /**
+     * Stream offset the input handle was opened at, a seek reopens the stream from there
+     */
+    int64_t m_readBase = 0;
+
+    /**
+     * Offset of the oldest data the backend still keeps
+     */
+    int64_t SlipBufferStart();
+
   public:
     ClientTimeShift() : RollingFile()
     {
@@ -62,7 +78,10 @@ namespace timeshift {
     }
     virtual ssize_t Read(byte *buffer, size_t length) override
     {
+      int64_t position = m_readBase + m_inputHandle.GetPosition();
       ssize_t dataLen = m_inputHandle.Read(buffer, length);
+      if (dataLen > 0)
+        m_index.Feed(position, buffer, static_cast<int>(dataLen));
       if (m_complete && dataLen == 0)
       {
         kodi::Log(ADDON_LOG_DEBUG, "%s:%d: %u %lld %lld", __FUNCTION__, __LINE__, length, m_inputHandle.GetLength() , m_inputHandle.GetPosition());
@@ -0,0 +1,92 @@
+/*
+ *  Copyright (C) 2020 Team Kodi
+ *  https://kodi.tv
+ *
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *  See LICENSE.md for more information.
+ */
+
+#include "LiveShiftParser.h"
+#include <kodi/General.h>
+#include <cstring>
+
+using namespace timeshift;
+
+namespace
+{
+  // Reads an unsigned decimal field, at most 18 digits so it cannot overflow
+  bool ScanField(const char*& pos, const char* end, int64_t& value)
+  {
+    const char* start = pos;
+    value = 0;
+    while (pos < end && *pos >= '0' && *pos <= '9' && pos - start < 18)
+      value = value * 10 + (*pos++ - '0');
+    return pos != start && (pos == end || *pos < '0' || *pos > '9');
+  }
+
+  // Skips field separators, false when there were none
+  bool SkipSpaces(const char*& pos, const char* end)
+  {
+    const char* start = pos;
+    while (pos < end && *pos == ' ')
+      pos++;
+    return pos != start;
+  }
+}
+
+bool LiveShiftParser::HeaderReceived(int count)
+{
+  if (m_state != WantHeader)
+    return false;
+  m_headerFill += count;
+  if (m_headerFill < HEADER_LENGTH)
+    return true;
+
+  if (!ParseHeader())
+  {
+    m_state = Failed;
+    return false;
+  }
+  m_headerFill = 0;
+  m_payloadDone = 0;
+  m_state = m_block.size > 0 ? WantPayload : WantHeader;
+  return true;
+}
+
+bool LiveShiftParser::PayloadReceived(int count)
+{
+  if (m_state != WantPayload)
+    return false;
+  m_payloadDone += count;
+  if (m_payloadDone < m_block.size)
+    return false;
+  m_state = WantHeader;
+  return true;
+}
+
+bool LiveShiftParser::ParseHeader()
+{
+  // the text ends at the first NUL, the rest of the header is padding
+  const char* pos = m_header;
+  const char* end = static_cast<const char*>(memchr(m_header, 0, HEADER_LENGTH));
+  if (!end)
+    end = m_header + HEADER_LENGTH;
+
+  int64_t offset, size, fileSize, request = 0;
+  bool valid = ScanField(pos, end, offset) && pos < end && *pos++ == ':' &&
+               ScanField(pos, end, size) && SkipSpaces(pos, end) &&
+               ScanField(pos, end, fileSize);
+  // the request number is not always present
+  if (valid && SkipSpaces(pos, end) && pos < end)
+    valid = ScanField(pos, end, request);
+  if (!valid || size > m_maxPayload)
+  {
+    kodi::Log(ADDON_LOG_ERROR, "LiveShiftParser: bad block header '%.*s'", static_cast<int>(end - m_header), m_header);
+    return false;
+  }
+  m_block.offset = offset;
+  m_block.size = static_cast<int32_t>(size);
+  m_block.fileSize = fileSize;
+  m_block.request = static_cast<int32_t>(request);
+  return true;
+}
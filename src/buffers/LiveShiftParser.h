@@ -0,0 +1,87 @@
+/*
+ *  Copyright (C) 2020 Team Kodi
+ *  https://kodi.tv
+ *
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *  See LICENSE.md for more information.
+ */
+
+#pragma once
+
+#include <kodi/AddonBase.h>
+#include <stdint.h>
+
+namespace timeshift {
+
+  /**
+   * Incremental parser for the liveshift block stream.
+   *
+   * Each block the backend sends is a 128 byte text header
+   * "offset:size fileSize request" padded with NULs, followed by size bytes
+   * of payload. Headers and payloads may arrive split over any number of
+   * reads, or several of them in one read. The parser only tracks where in
+   * the stream it is, the caller decides where payload bytes go.
+   */
+  class ATTRIBUTE_HIDDEN LiveShiftParser
+  {
+  public:
+    static const int HEADER_LENGTH = 128;
+
+    struct Block
+    {
+      int64_t offset = 0;
+      int32_t size = 0;
+      int64_t fileSize = 0;
+      int32_t request = 0;
+    };
+
+    enum State
+    {
+      WantHeader,
+      WantPayload,
+      Failed
+    };
+
+    explicit LiveShiftParser(int maxPayload) : m_maxPayload(maxPayload) {}
+
+    void Reset() { m_state = WantHeader; m_headerFill = 0; m_payloadDone = 0; m_block = Block(); }
+    void SetMaxPayload(int maxPayload) { m_maxPayload = maxPayload; }
+
+    State GetState() const { return m_state; }
+    const Block& Current() const { return m_block; }
+
+    /**
+     * Where the next header bytes can be received directly, and how many are still needed.
+     */
+    char* HeaderSpace() { return m_header + m_headerFill; }
+    int HeaderRemaining() const { return m_state == WantHeader ? HEADER_LENGTH - m_headerFill : 0; }
+
+    /**
+     * Account for count bytes received into HeaderSpace().
+     * @return false if a complete header did not validate, the parser is then Failed
+     */
+    bool HeaderReceived(int count);
+
+    /**
+     * Payload bytes of the current block still to come, and already received.
+     */
+    int PayloadRemaining() const { return m_state == WantPayload ? m_block.size - m_payloadDone : 0; }
+    int PayloadDone() const { return m_payloadDone; }
+
+    /**
+     * Account for count payload bytes the caller received itself.
+     * @return true when this completed the current block
+     */
+    bool PayloadReceived(int count);
+
+  private:
+    bool ParseHeader();
+
+    State m_state = WantHeader;
+    char m_header[HEADER_LENGTH];
+    int m_headerFill = 0;
+    int m_payloadDone = 0;
+    int m_maxPayload;
+    Block m_block;
+  };
+}
@@ -0,0 +1,210 @@
+/*
+ *  Copyright (C) 2020 Team Kodi
+ *  https://kodi.tv
+ *
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *  See LICENSE.md for more information.
+ */
+
+#include "PcrIndex.h"
+#include <kodi/General.h>
+#include <algorithm>
+#include <cstring>
+
+using namespace timeshift;
+
+namespace
+{
+  const byte SYNC_BYTE = 0x47;
+  // PCR is 33 bits of 90kHz clock
+  const int64_t PCR_WRAP = 1LL << 33;
+}
+
+void PcrIndex::Reset()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_entries.clear();
+  m_origin = NO_ORIGIN;
+  m_restart = -1;
+  m_pid = -1;
+  m_phase = -1;
+  m_carryLength = 0;
+  m_carryOffset = -1;
+  m_fedEnd = -1;
+}
+
+void PcrIndex::Feed(int64_t offset, const byte *data, int length)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  if (m_carryOffset >= 0)
+  {
+    if (offset == m_fedEnd)
+    {
+      const int count = std::min(PCR_HEADER - m_carryLength, length);
+      memcpy(m_carry + m_carryLength, data, count);
+      m_carryLength += count;
+      if (m_carryLength == PCR_HEADER)
+      {
+        Packet(m_carryOffset, m_carry);
+        m_carryOffset = -1;
+      }
+    }
+    else
+    {
+      m_carryOffset = -1;
+    }
+  }
+  m_fedEnd = offset + length;
+
+  int i = 0;
+  while (i < length)
+  {
+    if (m_phase < 0 && !Sync(offset + i, data + i, length - i))
+      break;
+    i += static_cast<int>(((m_phase - (offset + i) % PACKET_LENGTH) + PACKET_LENGTH) % PACKET_LENGTH);
+    for (; i < length; i += PACKET_LENGTH)
+    {
+      if (data[i] != SYNC_BYTE)
+      {
+        m_phase = -1;
+        break;
+      }
+      if (length - i >= PCR_HEADER)
+      {
+        Packet(offset + i, data + i);
+      }
+      else
+      {
+        // finish it when the rest arrives
+        memcpy(m_carry, data + i, length - i);
+        m_carryLength = length - i;
+        m_carryOffset = offset + i;
+      }
+    }
+  }
+}
+
+bool PcrIndex::Sync(int64_t offset, const byte *data, int length)
+{
+  for (int i = 0; i + 2 * PACKET_LENGTH < length; i++)
+  {
+    if (data[i] == SYNC_BYTE && data[i + PACKET_LENGTH] == SYNC_BYTE && data[i + 2 * PACKET_LENGTH] == SYNC_BYTE)
+    {
+      m_phase = static_cast<int>((offset + i) % PACKET_LENGTH);
+      return true;
+    }
+  }
+  return false;
+}
+
+void PcrIndex::Packet(int64_t offset, const byte *packet)
+{
+  // skip errored packets and those without an adaptation field carrying a PCR
+  if ((packet[1] & 0x80) || !(packet[3] & 0x20) || packet[4] < 7 || !(packet[5] & 0x10))
+    return;
+  const int pid = ((packet[1] & 0x1F) << 8) | packet[2];
+  if (m_pid == -1)
+    m_pid = pid;
+  if (pid != m_pid)
+    return;
+  const int64_t pcr = (static_cast<int64_t>(packet[6]) << 25) | (packet[7] << 17) | (packet[8] << 9) | (packet[9] << 1) | (packet[10] >> 7);
+  Add(offset, pcr, (packet[5] & 0x80) != 0);
+}
+
+int64_t PcrIndex::Expected(const Entry& previous, int64_t offset) const
+{
+  // clock ticks between previous and offset at the rate seen so far, -1 if there is no rate yet
+  const Entry& first = m_entries.front();
+  if (previous.offset <= first.offset || previous.pcr <= first.pcr)
+    return -1;
+  return (offset - previous.offset) * (previous.pcr - first.pcr) / (previous.offset - first.offset);
+}
+
+void PcrIndex::Add(int64_t offset, int64_t pcr, bool discontinuity)
+{
+  // stream from before the last discontinuity runs on the old clock
+  if (offset < m_restart)
+    return;
+  auto next = std::lower_bound(m_entries.begin(), m_entries.end(), offset,
+                               [](const Entry& entry, int64_t value) { return entry.offset < value; });
+  const Entry *neighbour = next != m_entries.begin() ? &*(next - 1) : (next != m_entries.end() ? &*next : nullptr);
+  if (neighbour)
+  {
+    // unwrap to the period of the entry next to it
+    pcr += (neighbour->pcr / PCR_WRAP) * PCR_WRAP;
+    if (pcr < neighbour->pcr - PCR_WRAP / 2)
+      pcr += PCR_WRAP;
+    else if (pcr > neighbour->pcr + PCR_WRAP / 2 && pcr >= PCR_WRAP)
+      pcr -= PCR_WRAP;
+  }
+
+  if (next != m_entries.begin())
+  {
+    const Entry& previous = *(next - 1);
+    const int64_t expected = Expected(previous, offset);
+    bool jump = false;
+    if (next == m_entries.end())
+    {
+      // flagged by the broadcaster, the clock went back, or it went forward
+      // well beyond what the bytes in between can account for
+      const int64_t delta = pcr - previous.pcr;
+      jump = discontinuity || delta < 0 || (expected < 0 ? delta > MAX_PCR_GAP : delta > 2 * expected + PCR_CLOCK);
+    }
+    if (jump)
+    {
+      // what was indexed no longer lines up. Carry on the session time from
+      // where it had got to, estimating the part since the last entry from
+      // the rate seen so far, so callers' times stay valid.
+      int64_t elapsed = previous.pcr - m_origin;
+      if (expected > 0)
+        elapsed += expected;
+      kodi::Log(ADDON_LOG_DEBUG, "%s:%d: PCR discontinuity at %lld, restarting index at %lld s", __FUNCTION__, __LINE__, offset, elapsed / PCR_CLOCK);
+      m_entries.clear();
+      m_origin = pcr - elapsed;
+      m_restart = offset;
+      next = m_entries.end();
+    }
+    else if (pcr - previous.pcr < INDEX_SPACING)
+      return;
+  }
+  if (next != m_entries.end() && (next->offset == offset || next->pcr - pcr < INDEX_SPACING))
+    return;
+
+  if (m_origin == NO_ORIGIN)
+    m_origin = pcr;
+  m_entries.insert(next, {offset, pcr});
+  if (m_entries.size() > MAX_ENTRIES)
+    m_entries.pop_front();
+}
+
+void PcrIndex::Trim(int64_t offset)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  // keep the entry before offset to interpolate from
+  while (m_entries.size() > 2 && m_entries[1].offset <= offset)
+    m_entries.pop_front();
+}
+
+int64_t PcrIndex::OffsetAt(double seconds) const
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  if (m_entries.size() < 2)
+    return -1;
+  const int64_t target = m_origin + static_cast<int64_t>(seconds * PCR_CLOCK);
+  if (target < m_entries.front().pcr || target > m_entries.back().pcr)
+    return -1;
+  auto it = std::lower_bound(m_entries.begin(), m_entries.end(), target,
+                             [](const Entry& entry, int64_t value) { return entry.pcr < value; });
+  if (it->pcr == target)
+    return it->offset;
+  const Entry& before = *(it - 1);
+  return before.offset + (target - before.pcr) * (it->offset - before.offset) / (it->pcr - before.pcr);
+}
+
+int64_t PcrIndex::Align(int64_t offset) const
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  if (m_phase < 0)
+    return offset;
+  return offset - ((offset - m_phase) % PACKET_LENGTH + PACKET_LENGTH) % PACKET_LENGTH;
+}
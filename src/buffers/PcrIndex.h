@@ -0,0 +1,93 @@
+/*
+ *  Copyright (C) 2020 Team Kodi
+ *  https://kodi.tv
+ *
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *  See LICENSE.md for more information.
+ */
+
+#pragma once
+
+#include <kodi/AddonBase.h>
+#include <deque>
+#include <mutex>
+#include <stdint.h>
+
+namespace timeshift {
+
+  /**
+   * Maps stream byte offsets to MPEG-TS PCR times.
+   *
+   * The stream is fed in as it is read. The PCR of the first PID carrying
+   * one is sampled every INDEX_SPACING ticks, times are in seconds from the
+   * first PCR indexed and run on across a PCR discontinuity, whether it is
+   * signalled in the adaptation field or only shows as a jump in either
+   * direction that the byte rate cannot explain. Only the first few bytes
+   * of each packet are looked at, so this is cheap enough to run on every block.
+   */
+  class ATTRIBUTE_HIDDEN PcrIndex
+  {
+  public:
+    static const int PACKET_LENGTH = 188;
+    static const int64_t PCR_CLOCK = 90000;
+    static const int64_t INDEX_SPACING = PCR_CLOCK / 2;
+    static const size_t MAX_ENTRIES = 65536;
+    // forward jump taken as a discontinuity while the byte rate is not known yet
+    static const int64_t MAX_PCR_GAP = PCR_CLOCK * 10;
+    // bytes of a packet needed to read its PCR
+    static const int PCR_HEADER = 11;
+
+    void Reset();
+
+    /**
+     * Index length bytes of stream that start at offset. Data following on
+     * from the previous call may start part way into a packet.
+     */
+    void Feed(int64_t offset, const byte *data, int length);
+
+    /**
+     * Forget entries before offset, once that part of the stream is gone.
+     */
+    void Trim(int64_t offset);
+
+    /**
+     * The stream offset for a time, interpolated between the entries around it.
+     * @return -1 when the time is outside what has been indexed
+     */
+    int64_t OffsetAt(double seconds) const;
+
+    /**
+     * Round offset down to the start of a TS packet, unchanged until the packet grid is known.
+     */
+    int64_t Align(int64_t offset) const;
+
+  private:
+    struct Entry
+    {
+      int64_t offset;
+      int64_t pcr;
+    };
+
+    void Packet(int64_t offset, const byte *packet);
+    void Add(int64_t offset, int64_t pcr, bool discontinuity);
+    int64_t Expected(const Entry& previous, int64_t offset) const;
+    bool Sync(int64_t offset, const byte *data, int length);
+
+    static const int64_t NO_ORIGIN = INT64_MIN;
+
+    mutable std::mutex m_mutex;
+    std::deque<Entry> m_entries;
+    // the PCR at time 0, rebased at each discontinuity
+    int64_t m_origin = NO_ORIGIN;
+    // stream offset of the last discontinuity, nothing before it is indexed any more
+    int64_t m_restart = -1;
+    int m_pid = -1;
+    int m_phase = -1;
+
+    // the start of a packet that straddled the end of the last Feed()
+    byte m_carry[PCR_HEADER];
+    int m_carryLength = 0;
+    int64_t m_carryOffset = -1;
+    int64_t m_fedEnd = -1;
+  };
+}
@@ -10,10 +10,18 @@
 #include "../BackendRequest.h"
 #include "../utilities/XMLUtils.h"
 #include "RecordingBuffer.h"
+#include <climits>
 
 using namespace NextPVR::utilities;
 using namespace timeshift;
 
+const int RecordingBuffer::READ_AHEAD_CHUNKS = 32;
+const int RecordingBuffer::READ_BEHIND_CHUNKS = 8;
+const int RecordingBuffer::TAIL_FOLLOW_MIN_WAIT = 100;
+const int RecordingBuffer::TAIL_FOLLOW_MAX_WAIT = 1000;
+const int RecordingBuffer::TAIL_FOLLOW_SECONDS = 5;
+const int RecordingBuffer::STATUS_INTERVAL = 10;
+
 PVR_ERROR RecordingBuffer::GetStreamTimes(kodi::addon::PVRStreamTimes& stimes)
 {
   stimes.SetStartTime(0);
@@ -28,30 +36,14 @@ PVR_ERROR RecordingBuffer::GetStreamTimes(kodi::addon::PVRStreamTimes& stimes)
 
 int RecordingBuffer::Duration(void)
 {
-  if (m_recordingTime)
+  const time_t recordingTime = m_recordingTime.load();
+  if (recordingTime)
   {
-    std::unique_lock<std::mutex> lock(m_mutex);
-    int diff = static_cast<int>(time(nullptr) - m_recordingTime) - 15;
+    int diff = static_cast<int>(time(nullptr) - recordingTime) - 15;
     if (diff > m_Duration)
     {
-      tinyxml2::XMLDocument doc;
-      if (m_request.DoMethodRequest("recording.list&recording_id=" + m_recordingID, doc) == tinyxml2::XML_SUCCESS)
-      {
-        tinyxml2::XMLElement* recordingNode = doc.RootElement()->FirstChildElement("recordings")->FirstChildElement("recording");
-        std::string status;
-
-        XMLUtils::GetString(recordingNode, "status", status);
-
-        if (status != "Recording")
-        {
-          diff = m_Duration;
-          m_recordingTime = 0;
-        }
-        else
-        {
-          m_Duration += 60;
-        }
-      }
+      // past the scheduled end, the status thread extends m_Duration or ends the recording
+      return diff;
     }
     else if (diff > 0)
     {
@@ -71,8 +63,80 @@ int RecordingBuffer::Duration(void)
   }
 }
 
+void RecordingBuffer::StartStatusWatch()
+{
+  m_statusUpdate = -1;
+  m_statusRunning.store(true);
+  m_statusThread = std::thread([this]()
+  {
+    WatchStatus();
+  });
+}
+
+void RecordingBuffer::StopStatusWatch()
+{
+  if (!m_statusThread.joinable())
+    return;
+  {
+    std::unique_lock<std::mutex> lock(m_statusLock);
+    m_statusRunning.store(false);
+    m_statusWake.notify_one();
+  }
+  m_statusThread.join();
+}
+
+void RecordingBuffer::WatchStatus()
+{
+  std::unique_lock<std::mutex> lock(m_statusLock);
+  while (m_recordingTime.load())
+  {
+    if (m_statusWake.wait_for(lock, std::chrono::seconds(STATUS_INTERVAL), [this]() { return !m_statusRunning; }))
+      break;
+    lock.unlock();
+    CheckStatus();
+    lock.lock();
+  }
+}
+
+void RecordingBuffer::CheckStatus()
+{
+  const time_t recordingTime = m_recordingTime.load();
+  if (recordingTime == 0 || static_cast<int>(time(nullptr) - recordingTime) - 15 <= m_Duration)
+    return;
+
+  // nothing about the recording has changed since it was last seen recording
+  time_t lastUpdate;
+  if (m_statusUpdate != -1 && m_request.GetLastUpdate("recording.lastupdated", lastUpdate) == tinyxml2::XML_SUCCESS && lastUpdate == m_statusUpdate)
+  {
+    m_Duration += 60;
+    return;
+  }
+
+  tinyxml2::XMLDocument doc;
+  if (m_request.DoMethodRequest("recording.list&recording_id=" + m_recordingID, doc) == tinyxml2::XML_SUCCESS)
+  {
+    tinyxml2::XMLElement* recordingNode = doc.RootElement()->FirstChildElement("recordings")->FirstChildElement("recording");
+    std::string status;
+
+    XMLUtils::GetString(recordingNode, "status", status);
+
+    if (status != "Recording")
+    {
+      kodi::Log(ADDON_LOG_DEBUG, "%s:%d: recording %s is %s", __FUNCTION__, __LINE__, m_recordingID.c_str(), status.c_str());
+      m_recordingTime.store(0);
+    }
+    else
+    {
+      m_Duration += 60;
+      if (m_request.GetLastUpdate("recording.lastupdated", lastUpdate) == tinyxml2::XML_SUCCESS)
+        m_statusUpdate = lastUpdate;
+    }
+  }
+}
+
 bool RecordingBuffer::Open(const std::string inputUrl, const kodi::addon::PVRRecording& recording)
 {
+  StopStatusWatch();
   m_Duration = recording.GetDuration();
 
   kodi::Log(ADDON_LOG_DEBUG, "RecordingBuffer::Open %d %lld", recording.GetDuration(), recording.GetRecordingTime());
@@ -88,6 +152,11 @@ bool RecordingBuffer::Open(const std::string inputUrl, const kodi::addon::PVRRec
     m_isLive = false;
   }
   m_recordingURL = inputUrl;
+  if (m_isLive && m_readAhead && m_recordingURL.find("/live?recording=") != std::string::npos && m_recordingURL.find("wait=") == std::string::npos)
+  {
+    // have the backend hold the stream open at the end of the file until the recording grows
+    m_recordingURL += "&wait=true";
+  }
   if (!recording.GetDirectory().empty() && m_isLive == false)
   {
     std::string kodiDirectory = recording.GetDirectory();
@@ -101,27 +170,308 @@ bool RecordingBuffer::Open(const std::string inputUrl, const kodi::addon::PVRRec
       m_recordingURL = kodiDirectory;
     }
   }
-  return Buffer::Open(m_recordingURL, ADDON_READ_NO_CACHE);
+  StopReadAhead();
+  if (!Buffer::Open(m_recordingURL, ADDON_READ_NO_CACHE))
+    return false;
+  if (m_readAhead)
+    StartReadAhead();
+  if (m_recordingTime && !m_recordingID.empty())
+    StartStatusWatch();
+  return true;
+}
+
+void RecordingBuffer::Close()
+{
+  StopStatusWatch();
+  StopReadAhead();
+  Buffer::Close();
+}
+
+void RecordingBuffer::StartReadAhead()
+{
+  const int chunk = m_settings.m_chunkRecording * 1024;
+  m_window.Resize(chunk * (READ_AHEAD_CHUNKS + READ_BEHIND_CHUNKS), chunk * READ_BEHIND_CHUNKS);
+  m_staging.resize(chunk);
+  m_readPosition.store(0);
+  m_inputLength.store(m_inputHandle.GetLength());
+  m_inputEnded.store(false);
+  m_readAheadRunning.store(true);
+  m_readAheadThread = std::thread([this]()
+  {
+    ReadAhead();
+  });
+}
+
+void RecordingBuffer::StopReadAhead()
+{
+  if (!m_readAheadThread.joinable())
+    return;
+  {
+    std::unique_lock<std::mutex> lock(m_windowLock);
+    m_readAheadRunning.store(false);
+    m_spaceFree.notify_one();
+    m_dataReady.notify_one();
+  }
+  m_readAheadThread.join();
+  RingStats& stats = m_window.Stats();
+  kodi::Log(ADDON_LOG_DEBUG, "RecordingBuffer read-ahead: in %llu out %llu adjusts %llu", stats.bytesIn.load(), stats.bytesOut.load(), stats.adjusts.load());
+  stats.Clear();
+}
+
+void RecordingBuffer::ReadAhead()
+{
+  const int chunk = m_settings.m_chunkRecording * 1024;
+  int idleWait = 0;
+  // when the input last stopped giving data, 0 while it flows
+  time_t idleSince = 0;
+  // bytes read into m_staging not yet in the window, and the seek generation they were read at
+  int staged = 0;
+  uint64_t stagedGeneration = 0;
+  while (m_readAheadRunning)
+  {
+    if (idleWait)
+    {
+      // the input had nothing for us, give it time rather than asking again at once.
+      // Nothing else is held, a seek that moves the input or a stop ends the wait.
+      std::unique_lock<std::mutex> lock(m_windowLock);
+      m_writerWaiting.store(true);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (m_spaceFree.wait_for(lock, std::chrono::milliseconds(idleWait), [this, stagedGeneration]()
+      {
+        return !m_readAheadRunning || m_seekGeneration != stagedGeneration;
+      }))
+      {
+        idleWait = 0;
+        idleSince = 0;
+      }
+      m_writerWaiting.store(false);
+    }
+
+    const int needed = staged ? staged : chunk;
+    if ((!staged && m_inputEnded) || m_window.BytesFree() < needed)
+    {
+      std::unique_lock<std::mutex> lock(m_windowLock);
+      m_writerWaiting.store(true);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      m_spaceFree.wait_for(lock, std::chrono::seconds(1), [this, needed, staged, stagedGeneration]()
+      {
+        return !m_readAheadRunning || (staged && m_seekGeneration != stagedGeneration) ||
+          ((staged || !m_inputEnded) && m_window.BytesFree() >= needed);
+      });
+      m_writerWaiting.store(false);
+      if (staged && m_seekGeneration != stagedGeneration)
+        staged = 0;
+      continue;
+    }
+
+    if (!staged)
+    {
+      // the network read only holds the handle, a seek within the window carries on meanwhile
+      std::unique_lock<std::mutex> lock(m_handleLock);
+      if (m_inputEnded)
+        continue;
+      stagedGeneration = m_seekGeneration;
+      ssize_t dataRead = ReadInput(m_staging.data(), chunk, false);
+      if (dataRead <= 0 && m_recordingTime && m_isLive)
+      {
+        // still recording, after TAIL_FOLLOW_SECONDS without growth the handle may have given up on it
+        if (!idleSince)
+        {
+          idleSince = time(nullptr);
+        }
+        else if (time(nullptr) - idleSince >= TAIL_FOLLOW_SECONDS)
+        {
+          idleSince = 0;
+          if (Reopen())
+            dataRead = ReadInput(m_staging.data(), chunk, false);
+        }
+      }
+      if (dataRead > 0)
+      {
+        staged = static_cast<int>(dataRead);
+        m_inputLength.store(m_inputHandle.GetLength());
+        idleWait = 0;
+        idleSince = 0;
+      }
+      else
+      {
+        if (!m_recordingTime)
+          m_inputEnded.store(true);
+        else if (!m_inputEnded)
+          idleWait = idleWait ? std::min(idleWait * 2, TAIL_FOLLOW_MAX_WAIT) : TAIL_FOLLOW_MIN_WAIT;
+        lock.unlock();
+        WakeReader();
+        continue;
+      }
+    }
+
+    {
+      std::unique_lock<std::mutex> lock(m_windowLock);
+      if (m_seekGeneration != stagedGeneration)
+      {
+        // the input was moved by a seek since, the chunk is from the old position
+        staged = 0;
+      }
+      else if (m_window.WriteBytes(m_staging.data(), staged))
+      {
+        staged = 0;
+      }
+      // otherwise a seek back took the room, the chunk goes in once there is space again
+    }
+    WakeReader();
+  }
+}
+
+void RecordingBuffer::WakeReader()
+{
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (m_readerWaiting.load())
+  {
+    std::unique_lock<std::mutex> lock(m_windowLock);
+    m_dataReady.notify_one();
+  }
+}
+
+void RecordingBuffer::WakeWriter()
+{
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (m_writerWaiting.load())
+  {
+    std::unique_lock<std::mutex> lock(m_windowLock);
+    m_spaceFree.notify_one();
+  }
 }
 
 ssize_t RecordingBuffer::Read(byte *buffer, size_t length)
+{
+  if (!m_readAheadRunning)
+    return ReadInput(buffer, length);
+
+  if (m_window.BytesAvailable() == 0)
+  {
+    std::unique_lock<std::mutex> lock(m_windowLock);
+    m_readerWaiting.store(true);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    m_dataReady.wait_for(lock, std::chrono::seconds(m_readTimeout), [this]()
+    {
+      return m_window.BytesAvailable() > 0 || m_inputEnded || !m_readAheadRunning;
+    });
+    m_readerWaiting.store(false);
+  }
+  int bytesRead = m_window.ReadBytes(buffer, static_cast<int>(std::min<size_t>(length, INT_MAX)));
+  m_readPosition.fetch_add(bytesRead);
+  WakeWriter();
+  return bytesRead;
+}
+
+int64_t RecordingBuffer::Seek(int64_t position, int whence)
+{
+  if (!m_readAheadRunning)
+  {
+    {
+      // cut short a wait in ReadInput() for the recording to grow
+      std::unique_lock<std::mutex> lock(m_windowLock);
+      m_seekGeneration++;
+      m_spaceFree.notify_all();
+    }
+    int64_t retval = m_inputHandle.Seek(position, whence);
+    kodi::Log(ADDON_LOG_DEBUG, "Seek: %s:%d  %lld  %lld %lld %lld", __FUNCTION__, __LINE__, position, m_inputHandle.GetPosition(), m_inputHandle.GetLength(), retval );
+    return retval;
+  }
+
+  const int64_t current = m_readPosition.load();
+  int64_t target;
+  if (whence == SEEK_SET)
+    target = position;
+  else if (whence == SEEK_CUR)
+    target = current + position;
+  else if (whence == SEEK_END)
+    target = m_inputLength.load() + position;
+  else
+    return -1;
+
+  // inside the window only the read position moves. Moving back takes free space
+  // away from the read-ahead thread, which only writes to the window under m_windowLock.
+  {
+    std::unique_lock<std::mutex> lock(m_windowLock);
+    const int64_t delta = target - current;
+    if (delta >= -m_window.BytesHistory() && delta <= m_window.BytesAvailable())
+    {
+      m_window.AdjustBytes(static_cast<int>(delta));
+      m_readPosition.store(target);
+      lock.unlock();
+      WakeWriter();
+      kodi::Log(ADDON_LOG_DEBUG, "Seek: %s:%d  %lld in window", __FUNCTION__, __LINE__, target);
+      return target;
+    }
+  }
+
+  int64_t retval;
+  {
+    std::unique_lock<std::mutex> handleLock(m_handleLock);
+    retval = m_inputHandle.Seek(target, SEEK_SET);
+    if (retval >= 0)
+    {
+      // a chunk read before the seek but not yet in the window is dropped
+      std::unique_lock<std::mutex> lock(m_windowLock);
+      m_seekGeneration++;
+      m_window.Reset();
+      m_readPosition.store(retval);
+      m_inputEnded.store(false);
+    }
+  }
+  WakeWriter();
+  kodi::Log(ADDON_LOG_DEBUG, "Seek: %s:%d  %lld  %lld %lld", __FUNCTION__, __LINE__, position, m_inputLength.load(), retval);
+  return retval;
+}
+
+ssize_t RecordingBuffer::ReadInput(byte *buffer, size_t length, bool follow)
 {
   if (m_recordingTime)
     std::unique_lock<std::mutex> lock(m_mutex);
   ssize_t dataRead = (int) m_inputHandle.Read(buffer, length);
-  if (dataRead == 0 && m_isLive)
+  if (dataRead == 0 && m_isLive && follow)
   {
+    // follow the growing recording on the open handle, backing off while it stays still
     kodi::Log(ADDON_LOG_DEBUG, "%s:%d: %lld %lld", __FUNCTION__, __LINE__, m_inputHandle.GetLength() , m_inputHandle.GetPosition());
-    const int64_t position = m_inputHandle.GetPosition();
     const time_t startTime = time(nullptr);
-    do {
-      Buffer::Close();
-      std::this_thread::sleep_for(std::chrono::milliseconds(2000));
-      Buffer::Open(m_recordingURL);
-      Seek(position, 0);
+    const uint64_t generation = m_seekGeneration;
+    auto interrupted = [this, generation]() { return m_seekGeneration != generation || (m_readAhead && !m_readAheadRunning); };
+    int wait = TAIL_FOLLOW_MIN_WAIT;
+    while (dataRead == 0 && time(nullptr) - startTime < TAIL_FOLLOW_SECONDS)
+    {
+      {
+        // Seek() and StopReadAhead() end the wait early
+        std::unique_lock<std::mutex> lock(m_windowLock);
+        if (m_spaceFree.wait_for(lock, std::chrono::milliseconds(wait), interrupted))
+          break;
+      }
+      wait = std::min(wait * 2, TAIL_FOLLOW_MAX_WAIT);
       dataRead = m_inputHandle.Read(buffer, length);
-    } while (dataRead == 0 && time(nullptr) - startTime < 5);
+    }
+    if (dataRead == 0 && m_recordingTime && !interrupted())
+    {
+      if (!Reopen())
+        return -1;
+      dataRead = m_inputHandle.Read(buffer, length);
+    }
     kodi::Log(ADDON_LOG_DEBUG, "%s:%d: %lld %lld", __FUNCTION__, __LINE__, m_inputHandle.GetLength() , m_inputHandle.GetPosition());
   }
   return dataRead;
 }
+
+bool RecordingBuffer::Reopen()
+{
+  // still recording but the handle has given up, connect again where it stopped
+  const int64_t position = m_inputHandle.GetPosition();
+  kodi::Log(ADDON_LOG_DEBUG, "%s:%d: reopening at %lld", __FUNCTION__, __LINE__, position);
+  Buffer::Close();
+  if (!Buffer::Open(m_recordingURL))
+  {
+    kodi::Log(ADDON_LOG_ERROR, "%s:%d: could not reopen recording", __FUNCTION__, __LINE__);
+    m_inputEnded.store(true);
+    return false;
+  }
+  m_inputHandle.Seek(position, SEEK_SET);
+  return true;
+}
@@ -10,7 +10,9 @@
 #pragma once
 
 #include "Buffer.h"
-
+#include "CircularBuffer.h"
+#include <condition_variable>
+#include <vector>
 
 namespace timeshift {
 
@@ -21,23 +23,124 @@ namespace timeshift {
   class ATTRIBUTE_HIDDEN RecordingBuffer : public Buffer
   {
   private:
-    int m_Duration;
+    std::atomic<int> m_Duration;
     bool m_buffering = false;
     std::string m_recordingURL;
     std::string m_recordingID;
 
+    const static int READ_AHEAD_CHUNKS;
+    const static int READ_BEHIND_CHUNKS;
+    const static int TAIL_FOLLOW_MIN_WAIT;
+    const static int TAIL_FOLLOW_MAX_WAIT;
+    const static int TAIL_FOLLOW_SECONDS;
+
+    /**
+     * The thread that keeps m_window filled ahead of the read position
+     */
+    std::thread m_readAheadThread;
+    std::atomic<bool> m_readAheadRunning;
+
+    /**
+     * Data read from m_inputHandle but not yet passed to Kodi, plus some
+     * already passed on so short seeks back are served from memory
+     */
+    CircularBuffer m_window;
+
+    /**
+     * Protects m_inputHandle while the read-ahead thread runs
+     */
+    std::mutex m_handleLock;
+
+    /**
+     * Chunk read from m_inputHandle before it is copied into m_window, so the
+     * network read does not hold on to the window
+     */
+    std::vector<byte> m_staging;
+
+    /**
+     * Waits for data (Read) and for space (ReadAhead). Also held while a
+     * chunk is written into m_window and while a seek moves its read side.
+     */
+    std::mutex m_windowLock;
+    std::condition_variable m_dataReady;
+    std::condition_variable m_spaceFree;
+    std::atomic<bool> m_readerWaiting;
+    std::atomic<bool> m_writerWaiting;
+
+    /**
+     * Counts seeks that moved m_inputHandle, a chunk read at an older one is
+     * dropped. Changed under m_windowLock so waits on m_spaceFree see it.
+     */
+    std::atomic<uint64_t> m_seekGeneration{0};
+
+    /**
+     * The input returned no more data, cleared by a seek
+     */
+    std::atomic<bool> m_inputEnded;
+
+    /**
+     * Stream offset of the next byte Read() returns
+     */
+    std::atomic<int64_t> m_readPosition;
+
+    /**
+     * Length of the input as of the last read, so Length() doesn't wait on the handle
+     */
+    std::atomic<int64_t> m_inputLength;
+
+    const static int STATUS_INTERVAL;
+
+    /**
+     * The thread that asks the backend whether a recording that has run past
+     * its scheduled end is still going, so Duration() never has to
+     */
+    std::thread m_statusThread;
+    std::atomic<bool> m_statusRunning;
+    std::mutex m_statusLock;
+    std::condition_variable m_statusWake;
+
+    /**
+     * recording.lastupdated when the status was last read, -1 before the first check
+     */
+    time_t m_statusUpdate;
+
+    void StartStatusWatch();
+    void StopStatusWatch();
+    void WatchStatus();
+    void CheckStatus();
+
+    void StartReadAhead();
+    void StopReadAhead();
+    void ReadAhead();
+    void WakeReader();
+    void WakeWriter();
+    bool Reopen();
+
+  protected:
+    /**
+     * Whether Open() starts the read-ahead thread. Derived classes that read
+     * m_inputHandle themselves turn it off.
+     */
+    bool m_readAhead = true;
+
+    /**
+     * Read straight from the input handle. At the end of a recording still in
+     * progress, wait on the same handle for it to grow unless follow is off,
+     * the read-ahead thread backs off between reads itself.
+     */
+    ssize_t ReadInput(byte *buffer, size_t length, bool follow = true);
+
   public:
-    RecordingBuffer() : Buffer() { m_Duration = 0; kodi::Log(ADDON_LOG_INFO, "RecordingBuffer created!"); }
-    virtual ~RecordingBuffer() {}
+    RecordingBuffer() : Buffer(), m_readAheadRunning(false), m_window(0), m_readerWaiting(false), m_writerWaiting(false),
+      m_inputEnded(false), m_readPosition(0), m_inputLength(0),
+      m_statusRunning(false), m_statusUpdate(-1), m_recordingTime(0) { m_Duration = 0; kodi::Log(ADDON_LOG_INFO, "RecordingBuffer created!"); }
+    virtual ~RecordingBuffer() { StopStatusWatch(); StopReadAhead(); }
+
+    virtual void Close() override;
 
     virtual ssize_t Read(byte *buffer, size_t length) override;
 
-    virtual int64_t Seek(int64_t position, int whence) override
-    {
-      int64_t retval = m_inputHandle.Seek(position, whence);
-      kodi::Log(ADDON_LOG_DEBUG, "Seek: %s:%d  %lld  %lld %lld %lld", __FUNCTION__, __LINE__, position, m_inputHandle.GetPosition(), m_inputHandle.GetLength(), retval );
-      return retval;
-    }
+    virtual int64_t Seek(int64_t position, int whence) override;
 
     virtual bool CanPauseStream() const override
     {
@@ -46,7 +149,7 @@ namespace timeshift {
 
     virtual bool CanSeekStream() const override
     {
-      return m_inputHandle.GetLength() != 0;
+      return RecordingBuffer::Length() != 0;
     }
 
     virtual bool IsRealTimeStream() const override
@@ -58,16 +161,20 @@ namespace timeshift {
 
     virtual int64_t Length() const override
     {
+      if (m_readAheadRunning)
+        return m_inputLength.load();
       return m_inputHandle.GetLength();
     }
     virtual int64_t Position() const override
     {
+      if (m_readAheadRunning)
+        return m_readPosition.load();
       return m_inputHandle.GetPosition();
     }
 
     virtual int Duration(void);
-    int GetDuration(void) { return m_Duration; kodi::Log(ADDON_LOG_ERROR, "Duration get %d", m_Duration); }
-    void SetDuration(int duration) { m_Duration = duration; kodi::Log(ADDON_LOG_ERROR, "Duration set to %d", m_Duration); }
+    int GetDuration(void) { return m_Duration; kodi::Log(ADDON_LOG_ERROR, "Duration get %d", m_Duration.load()); }
+    void SetDuration(int duration) { m_Duration = duration; kodi::Log(ADDON_LOG_ERROR, "Duration set to %d", m_Duration.load()); }
 
    PVR_ERROR GetStreamReadChunkSize(int* chunksize)
     {
@@ -79,7 +186,7 @@ namespace timeshift {
 
     std::atomic<bool> m_isLive;
 
-    // recording start time
-    time_t m_recordingTime;
+    // recording start time, 0 once the recording is complete
+    std::atomic<time_t> m_recordingTime;
   };
 }
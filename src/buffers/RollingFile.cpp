@@ -11,7 +11,8 @@
 #include  "../BackendRequest.h"
 #include  "../pvrclient-nextpvr.h"
 #include "../utilities/XMLUtils.h"
-#include <regex>
+#include <algorithm>
+#include <cstring>
 #include <mutex>
 
 //#define TESTURL "d:/downloads/abc.ts"
@@ -19,6 +20,8 @@
 using namespace NextPVR::utilities;
 using namespace timeshift;
 
+const int RollingFile::PREFETCH_CHUNKS = 8;
+
 /* Rolling File mode functions */
 
 bool RollingFile::Open(const std::string inputUrl)
@@ -28,6 +31,7 @@ bool RollingFile::Open(const std::string inputUrl)
   m_nextStreamInfo = 0;
   m_nextRoll = 0;
   m_complete = false;
+  m_streamInfoValid = false;
   m_isRadio = g_pvrclient->IsRadio();
 
   m_stream_duration = 0;
@@ -36,6 +40,9 @@ bool RollingFile::Open(const std::string inputUrl)
   m_isLive = true;
 
   slipFiles.clear();
+  DropPrefetched();
+  m_activeHandle = &m_inputHandle;
+  m_spareHandle = &m_nextHandle;
   std::stringstream ss;
 
   ss << inputUrl ;//<< "|connection-timeout=" << 15;
@@ -62,21 +69,20 @@ bool RollingFile::Open(const std::string inputUrl)
     // epgmode=true requires a 10 second pause changing channels
     std::this_thread::sleep_for(std::chrono::milliseconds(1000));
     waitTime--;
-    if ( RollingFile::GetStreamInfo())
+    if ( ReadStreamInfo())
     {
       m_lastClose = 0;
     }
   }  while ((m_lastClose + 10) > time(nullptr));
 
-  if ( !RollingFile::GetStreamInfo())
+  if ( !ReadStreamInfo())
   {
     kodi::Log(ADDON_LOG_ERROR, "Could not read rolling file");
     return false;
   }
   m_rollingStartSeconds = m_streamStart = time(nullptr);
   kodi::Log(ADDON_LOG_DEBUG, "RollingFile::Open in Rolling File Mode: %d", m_isEpgBased);
-  m_activeFilename = slipFiles.back().filename;
-  m_activeLength = -1;
+  SetActiveFile(slipFiles.back().filename, -1);
   m_isLeaseRunning = true;
   m_leaseThread = std::thread([this]()
   {
@@ -86,34 +92,210 @@ bool RollingFile::Open(const std::string inputUrl)
   while (m_stream_length < waitTime)
   {
     std::this_thread::sleep_for(std::chrono::milliseconds(500));
-    RollingFile::GetStreamInfo();
+    ReadStreamInfo();
   };
   return  RollingFile::RollingFileOpen();
 }
 
-bool RollingFile::RollingFileOpen()
+std::string RollingFile::SlipFileURL(const std::string& filename, bool inProgress)
 {
-  kodi::addon::PVRRecording recording;
-  recording.SetRecordingTime(time(nullptr));
-  recording.SetDuration(5 * 60 * 60);
-  #if !defined(TESTURL)
-  recording.SetDirectory(m_activeFilename);
-  #endif
-
   #if defined(TESTURL)
-  const std::string URL = TESTURL;
+  return TESTURL;
   #else
-  std::string URL = kodi::tools::StringUtils::Format("%s/stream?f=%s&mode=http&sid=%s", m_settings.m_urlBase, UriEncode(m_activeFilename).c_str(), m_request.GetSID());
-  if (m_isRadio && m_activeLength == -1)
+  std::string URL = kodi::tools::StringUtils::Format("%s/stream?f=%s&mode=http&sid=%s", m_settings.m_urlBase, UriEncode(filename).c_str(), m_request.GetSID().c_str());
+  if (m_isRadio && inProgress)
   {
     // reduce buffer for radio when playing in-progess slip file
     URL += "&bufsize=32768&wait=true";
   }
+  return URL + "|connection-timeout=" + std::to_string(m_readTimeout);
   #endif
-  return RecordingBuffer::Open(URL.c_str(), recording);
+}
+
+bool RollingFile::RollingFileOpen()
+{
+  CloseActive();
+  m_active = true;
+  m_startTime = time(nullptr);
+  std::string URL;
+  {
+    // the lease thread sets the length once the file is complete
+    std::unique_lock<std::mutex> lock(m_prefetchLock);
+    URL = SlipFileURL(m_activeFilename, m_activeLength == -1);
+  }
+  kodi::Log(ADDON_LOG_DEBUG, "RollingFileOpen [ %s ]", URL.c_str());
+  return m_activeHandle->OpenFile(URL, ADDON_READ_NO_CACHE);
+}
+
+void RollingFile::SetActiveFile(const std::string& filename, int64_t length)
+{
+  std::unique_lock<std::mutex> lock(m_prefetchLock);
+  m_activeFilename = filename;
+  m_activeLength = length;
+}
+
+void RollingFile::CloseActive()
+{
+  CloseHandle(*m_activeHandle);
+  m_prefetchData.clear();
+  m_prefetchRead = 0;
+}
+
+bool RollingFile::TakePrefetched()
+{
+  std::unique_lock<std::mutex> lock(m_prefetchLock);
+  if (m_prefetchFilename.empty())
+    return false;
+  if (m_prefetchFilename != m_activeFilename)
+  {
+    kodi::Log(ADDON_LOG_DEBUG, "%s:%d: prefetched %s not needed", __FUNCTION__, __LINE__, m_prefetchFilename.c_str());
+    CloseHandle(*m_spareHandle);
+    m_prefetchFilename.clear();
+    return false;
+  }
+  CloseHandle(*m_activeHandle);
+  std::swap(m_activeHandle, m_spareHandle);
+  m_prefetchFilename.clear();
+  m_prefetchData.swap(m_prefetchBuffered);
+  m_prefetchBuffered.clear();
+  m_prefetchRead = 0;
+  m_active = true;
+  kodi::Log(ADDON_LOG_DEBUG, "%s:%d: switched to prefetched %s, %d bytes buffered", __FUNCTION__, __LINE__, m_activeFilename.c_str(), (int )m_prefetchData.size());
+  return true;
+}
+
+void RollingFile::DropPrefetched()
+{
+  std::unique_lock<std::mutex> lock(m_prefetchLock);
+  CloseHandle(*m_spareHandle);
+  m_prefetchFilename.clear();
+  m_prefetchBuffered.clear();
+}
+
+void RollingFile::Prefetch()
+{
+  std::string next;
+  int64_t nextLength = -1;
+  {
+    std::unique_lock<std::mutex> lock(m_prefetchLock);
+    for (auto File = slipFiles.begin(); File != slipFiles.end(); ++File)
+    {
+      if (File->filename == m_activeFilename)
+      {
+        if (++File != slipFiles.end())
+        {
+          next = File->filename;
+          nextLength = File->length;
+        }
+        break;
+      }
+    }
+    if (next.empty() || next == m_prefetchFilename)
+      return;
+    if (!m_prefetchFilename.empty())
+    {
+      // the active file moved by a seek, this one is no longer next
+      CloseHandle(*m_spareHandle);
+      m_prefetchFilename.clear();
+    }
+  }
+
+  // the spare handle is only touched here until it is published
+  const std::string URL = SlipFileURL(next, nextLength == -1);
+  if (!m_spareHandle->OpenFile(URL, ADDON_READ_NO_CACHE))
+  {
+    kodi::Log(ADDON_LOG_ERROR, "%s:%d: could not open %s", __FUNCTION__, __LINE__, URL.c_str());
+    return;
+  }
+  // Read blocks until the whole buffer is filled, so take a chunk at a time and stop at
+  // the first short read or when the lease thread is asked to stop. An in-progress radio
+  // file holds every read until the backend has that much, it is only opened ahead.
+  std::vector<byte> data;
+  const size_t chunk = m_settings.m_liveChunkSize * 1024;
+  const bool waits = m_isRadio && nextLength == -1;
+  for (int i = 0; i < PREFETCH_CHUNKS && !waits && m_isLeaseRunning; i++)
+  {
+    const size_t used = data.size();
+    data.resize(used + chunk);
+    ssize_t dataRead = m_spareHandle->Read(data.data() + used, chunk);
+    data.resize(used + (dataRead > 0 ? dataRead : 0));
+    if (dataRead < static_cast<ssize_t>(chunk))
+      break;
+  }
+
+  std::unique_lock<std::mutex> lock(m_prefetchLock);
+  if (next == m_activeFilename)
+  {
+    // Read() got there first and opened it itself
+    CloseHandle(*m_spareHandle);
+    return;
+  }
+  m_prefetchFilename = next;
+  m_prefetchBuffered.swap(data);
+  kodi::Log(ADDON_LOG_DEBUG, "%s:%d: %s ready, %d bytes buffered", __FUNCTION__, __LINE__, next.c_str(), (int )m_prefetchBuffered.size());
+}
+
+ssize_t RollingFile::ReadActive(byte *buffer, size_t length)
+{
+  if (m_prefetchRead < m_prefetchData.size())
+  {
+    const size_t count = std::min(length, m_prefetchData.size() - m_prefetchRead);
+    memcpy(buffer, m_prefetchData.data() + m_prefetchRead, count);
+    m_prefetchRead += count;
+    if (m_prefetchRead == m_prefetchData.size())
+    {
+      m_prefetchData.clear();
+      m_prefetchRead = 0;
+    }
+    return count;
+  }
+  return m_activeHandle->Read(buffer, length);
+}
+
+namespace
+{
+  /**
+   * EPG based slip files are named <name>_20<date>_<HHMM><HHMM>.ts, the last
+   * two fields being the start and end time of the programme.
+   */
+  bool ParseSlipTimes(const std::string& filename, int& startTime, int& endTime)
+  {
+    const size_t length = filename.length();
+    if (length < 16 || filename.compare(length - 3, 3, ".ts") != 0)
+      return false;
+    const size_t times = length - 11;
+    if (filename[times - 1] != '_')
+      return false;
+    int values[2] = {0, 0};
+    for (size_t i = 0; i < 8; i++)
+    {
+      const char c = filename[times + i];
+      if (c < '0' || c > '9')
+        return false;
+      values[i / 4] = values[i / 4] * 10 + (c - '0');
+    }
+    // something, then _20, then at least one character before the times
+    const size_t marker = filename.find("_20", 1);
+    if (marker == std::string::npos || marker + 3 >= times - 1)
+      return false;
+    startTime = values[0];
+    endTime = values[1];
+    return true;
+  }
 }
 
 bool RollingFile::GetStreamInfo()
+{
+  // the read path asks often, only go to the backend once the last answer is due for renewal
+  const time_t now = time(nullptr);
+  if (m_streamInfoValid && now < m_nextStreamInfo && now < m_nextRoll)
+    return true;
+  const bool valid = ReadStreamInfo();
+  m_streamInfoValid.store(valid);
+  return valid;
+}
+
+bool RollingFile::ReadStreamInfo()
 {
   enum infoReturns
   {
@@ -141,6 +323,8 @@ bool RollingFile::GetStreamInfo()
       tinyxml2::XMLNode* filesNode = doc.FirstChildElement("Files");
       if (filesNode != nullptr)
       {
+        // Prefetch() walks slipFiles on the lease thread
+        std::unique_lock<std::mutex> lock(m_prefetchLock);
         stream_length = strtoll(filesNode->FirstChildElement("Length")->GetText(), nullptr, 10);
         duration = strtoll(filesNode->FirstChildElement("Duration")->GetText(), nullptr, 10);
         XMLUtils::GetBoolean(filesNode, "Complete", m_complete);
@@ -205,30 +389,20 @@ bool RollingFile::GetStreamInfo()
           newFile.offset =  offset;
           newFile.length = -1;
           newFile.seconds = time(nullptr);
+          newFile.hasTimes = ParseSlipTimes(newFile.filename, newFile.startTime, newFile.endTime);
           slipFiles.push_back(newFile);
           if (m_isEpgBased)
           {
-            std::regex base_regex(".+_20.+_(\\d{4})(\\d{4})\\.ts");
-            std::smatch base_match;
-            if (std::regex_match(newFile.filename , base_match, base_regex))
+            if (newFile.hasTimes)
             {
-              // The first sub_match is the whole string; the next
-              // sub_match is the first parenthesized expression.
-              if (base_match.size() == 3)
+              kodi::Log(ADDON_LOG_DEBUG, "channel.stream.info %d %d", newFile.startTime, newFile.endTime);
+              if (newFile.startTime < newFile.endTime)
               {
-                std::ssub_match base_sub_match = base_match[1];
-                int startTime = std::stoi(base_sub_match.str());
-                base_sub_match = base_match[2];
-                int endTime = std::stoi(base_sub_match.str());
-                kodi::Log(ADDON_LOG_DEBUG, "channel.stream.info %d %d", startTime, endTime);
-                if (startTime < endTime)
-                {
-                  m_nextRoll = (time(nullptr) / 60) * 60 + (endTime - startTime) * 60 - 3 + m_settings.m_serverTimeOffset;
-                }
-                else
-                {
-                  m_nextRoll = (time(nullptr) / 60) * 60 + (2400 - startTime + endTime) * 60 - 3  + m_settings.m_serverTimeOffset;
-                }
+                m_nextRoll = (time(nullptr) / 60) * 60 + (newFile.endTime - newFile.startTime) * 60 - 3 + m_settings.m_serverTimeOffset;
+              }
+              else
+              {
+                m_nextRoll = (time(nullptr) / 60) * 60 + (2400 - newFile.startTime + newFile.endTime) * 60 - 3  + m_settings.m_serverTimeOffset;
               }
             }
             if (m_nextRoll == 0)
@@ -288,16 +462,20 @@ PVR_ERROR RollingFile::GetStreamTimes(kodi::addon::PVRStreamTimes& stimes)
 
 void RollingFile::Close()
 {
+  // the lease thread prefetches on the spare handle, stop it before closing anything
+  m_isLeaseRunning = false;
+  if (m_leaseThread.joinable())
+    m_leaseThread.join();
+
   if (m_slipHandle.IsOpen())
   {
+    DropPrefetched();
+    CloseActive();
     RecordingBuffer::Close();
     std::this_thread::sleep_for(std::chrono::milliseconds(500));
     m_slipHandle.Close();
     kodi::Log(ADDON_LOG_DEBUG, "%s:%d:", __FUNCTION__, __LINE__);
   }
-  m_isLeaseRunning = false;
-  if (m_leaseThread.joinable())
-    m_leaseThread.join();
 
   m_lastClose = time(nullptr);
 }
@@ -306,56 +484,69 @@ ssize_t RollingFile::Read(byte *buffer, size_t length)
 {
   std::unique_lock<std::mutex> lock(m_mutex);
   bool foundFile = false;
-  ssize_t dataRead = m_inputHandle.Read(buffer, length);
+  ssize_t dataRead = ReadActive(buffer, length);
   if (dataRead == 0)
   {
     RollingFile::GetStreamInfo();
-    if (m_inputHandle.GetPosition() == m_activeLength)
+    int64_t activeLength;
     {
-      RecordingBuffer::Close();
-      for (std::list<slipFile>::reverse_iterator File=slipFiles.rbegin(); File!=slipFiles.rend(); ++File)
+      // the lease thread updates the slip files and the active length
+      std::unique_lock<std::mutex> fileLock(m_prefetchLock);
+      activeLength = m_activeLength;
+    }
+    if (m_activeHandle->GetPosition() == activeLength)
+    {
+      std::string nextFilename;
+      int64_t nextLength = -1;
       {
-        if (File->filename == m_activeFilename)
+        std::unique_lock<std::mutex> fileLock(m_prefetchLock);
+        for (std::list<slipFile>::reverse_iterator File=slipFiles.rbegin(); File!=slipFiles.rend(); ++File)
         {
-          foundFile = true;
-          if (File==slipFiles.rbegin())
-          {
-            // still waiting for new filename
-            kodi::Log(ADDON_LOG_ERROR, "%s:%d: waiting %s  %s", __FUNCTION__, __LINE__, File->filename.c_str(), m_activeFilename.c_str());
-          }
-          else
+          if (File->filename == m_activeFilename)
           {
-            --File;
-            m_activeFilename = File->filename;
-            m_activeLength = File->length;
+            foundFile = true;
+            if (File==slipFiles.rbegin())
+            {
+              // still waiting for new filename
+              kodi::Log(ADDON_LOG_ERROR, "%s:%d: waiting %s  %s", __FUNCTION__, __LINE__, File->filename.c_str(), m_activeFilename.c_str());
+            }
+            else
+            {
+              --File;
+              nextFilename = File->filename;
+              nextLength = File->length;
+            }
+            break;
           }
-          break;
+        }
+        if (foundFile == false && !slipFiles.empty())
+        {
+          // file removed from slip file
+          nextFilename = slipFiles.front().filename;
+          nextLength = slipFiles.front().length;
         }
       }
-      if (foundFile == false)
-      {
-        // file removed from slip file
-        m_activeFilename = slipFiles.front().filename;
-        m_activeLength = slipFiles.front().length;
-      }
-      RollingFile::RollingFileOpen();
-      dataRead = m_inputHandle.Read(buffer, length);
+      if (!nextFilename.empty())
+        SetActiveFile(nextFilename, nextLength);
+      if (!TakePrefetched())
+        RollingFile::RollingFileOpen();
+      dataRead = ReadActive(buffer, length);
     }
     else
     {
-      while( m_inputHandle.GetPosition() == m_inputHandle.GetLength())
+      while( m_activeHandle->GetPosition() == m_activeHandle->GetLength())
       {
         RollingFile::GetStreamInfo();
         if (m_nextRoll == std::numeric_limits<time_t>::max())
         {
-          kodi::Log(ADDON_LOG_DEBUG, "should exit %s:%d: %lld %lld %lld", __FUNCTION__, __LINE__, Length(),  m_inputHandle.GetLength() , m_inputHandle.GetPosition());
+          kodi::Log(ADDON_LOG_DEBUG, "should exit %s:%d: %lld %lld %lld", __FUNCTION__, __LINE__, Length(),  m_activeHandle->GetLength() , m_activeHandle->GetPosition());
           return 0;
         }
-        kodi::Log(ADDON_LOG_DEBUG, "should exit %s:%d: %lld %lld %lld", __FUNCTION__, __LINE__, Length(),  m_inputHandle.GetLength() , m_inputHandle.GetPosition());
+        kodi::Log(ADDON_LOG_DEBUG, "should exit %s:%d: %lld %lld %lld", __FUNCTION__, __LINE__, Length(),  m_activeHandle->GetLength() , m_activeHandle->GetPosition());
         std::this_thread::sleep_for(std::chrono::milliseconds(200));
       }
     }
-    kodi::Log(ADDON_LOG_DEBUG, "%s:%d: %d %d %lld %lld", __FUNCTION__, __LINE__, length, dataRead, m_inputHandle.GetLength() , m_inputHandle.GetPosition());
+    kodi::Log(ADDON_LOG_DEBUG, "%s:%d: %d %d %lld %lld", __FUNCTION__, __LINE__, length, dataRead, m_activeHandle->GetLength() , m_activeHandle->GetPosition());
   }
   return dataRead;
 }
@@ -365,32 +556,38 @@ int64_t RollingFile::Seek(int64_t position, int whence)
   slipFile prevFile;
   int64_t adjust;
   RollingFile::GetStreamInfo();
-  prevFile = slipFiles.front();
-  if (slipFiles.back().offset <= position)
+  // work on a copy, the lease thread updates the slip files
+  std::list<slipFile> files;
+  std::string activeFilename;
+  {
+    std::unique_lock<std::mutex> lock(m_prefetchLock);
+    files = slipFiles;
+    activeFilename = m_activeFilename;
+  }
+  if (files.empty())
+    return -1;
+  prevFile = files.front();
+  if (files.back().offset <= position)
   {
     // seek on head
-    if ( m_activeFilename != slipFiles.back().filename)
+    if (activeFilename != files.back().filename)
     {
-      RecordingBuffer::Close();
-      m_activeFilename = slipFiles.back().filename;
-      m_activeLength = slipFiles.back().length;
+      SetActiveFile(files.back().filename, files.back().length);
       RollingFile::RollingFileOpen();
     }
-    adjust = slipFiles.back().offset;
+    adjust = files.back().offset;
   }
   else
   {
-    for (auto File : slipFiles )
+    for (auto File : files )
     {
       if (position < File.offset)
       {
         kodi::Log(ADDON_LOG_INFO, "Found slip file %s %lld", prevFile.filename.c_str(), prevFile.offset);
         adjust = prevFile.offset;
-        if ( m_activeFilename != prevFile.filename)
+        if (activeFilename != prevFile.filename)
         {
-          RecordingBuffer::Close();
-          m_activeFilename = prevFile.filename;
-          m_activeLength = prevFile.length;
+          SetActiveFile(prevFile.filename, prevFile.length);
           RollingFile::RollingFileOpen();
         }
         break;
@@ -406,7 +603,10 @@ int64_t RollingFile::Seek(int64_t position, int whence)
   {
     adjust = position;
   }
-  int64_t seekval = RecordingBuffer::Seek(position - adjust, whence);
+  // data passed on from a prefetch is behind the handle position
+  m_prefetchData.clear();
+  m_prefetchRead = 0;
+  int64_t seekval = m_activeHandle->Seek(position - adjust, whence);
   kodi::Log(ADDON_LOG_DEBUG, "%s:%d: %lld %d %lld", __FUNCTION__, __LINE__, position, adjust, seekval);
   return seekval;
 }
@@ -13,6 +13,7 @@
 #include <thread>
 #include <mutex>
 #include <list>
+#include <vector>
 
 
 namespace timeshift {
@@ -28,6 +29,45 @@ namespace timeshift {
     int64_t m_activeLength;
     bool m_isRadio = false;
 
+    const static int PREFETCH_CHUNKS;
+
+    /**
+     * The slip file being read is open on m_activeHandle. The other handle is
+     * opened on the next slip file by Prefetch() before the active one ends,
+     * and the two are swapped when it does.
+     */
+    kodi::vfs::CFile m_nextHandle;
+    kodi::vfs::CFile *m_activeHandle = &m_inputHandle;
+    kodi::vfs::CFile *m_spareHandle = &m_nextHandle;
+
+    /**
+     * Held while slipFiles, m_activeFilename or m_activeLength change, and
+     * wherever they are read since the lease thread updates them. Also
+     * protects the prefetch state below.
+     */
+    mutable std::mutex m_prefetchLock;
+
+    /**
+     * The slip file open on m_spareHandle, empty until it is ready, and its
+     * first few chunks already read from the handle
+     */
+    std::string m_prefetchFilename;
+    std::vector<byte> m_prefetchBuffered;
+
+    /**
+     * What is left of m_prefetchBuffered once that file is active, Read()
+     * passes it on before reading the handle
+     */
+    std::vector<byte> m_prefetchData;
+    size_t m_prefetchRead = 0;
+
+    std::string SlipFileURL(const std::string& filename, bool inProgress);
+    void SetActiveFile(const std::string& filename, int64_t length);
+    bool TakePrefetched();
+    void DropPrefetched();
+    ssize_t ReadActive(byte *buffer, size_t length);
+    void CloseActive();
+
   protected:
     kodi::vfs::CFile m_slipHandle;
     time_t m_streamStart;
@@ -49,14 +89,32 @@ namespace timeshift {
       int64_t offset;
       int64_t length;
       int seconds;
+      // programme times (HHMM) from an EPG based filename, parsed once when the file is listed
+      bool hasTimes = false;
+      int startTime = 0;
+      int endTime = 0;
     };
 
+    /**
+     * Whether the last channel.stream.info succeeded, GetStreamInfo() reuses
+     * it until m_nextStreamInfo or m_nextRoll. Set from both the read path
+     * and the lease thread.
+     */
+    std::atomic<bool> m_streamInfoValid{false};
+
+    /**
+     * Ask the backend for channel.stream.info and update the slip files
+     */
+    bool ReadStreamInfo();
+
     std::list <slipFile> slipFiles;
 
   public:
     RollingFile() : RecordingBuffer()
     {
       m_lastClose = 0;
+      // reads m_inputHandle itself
+      m_readAhead = false;
       kodi::Log(ADDON_LOG_INFO, "EPG Based Buffer created!");
     }
 
@@ -78,7 +136,12 @@ namespace timeshift {
 
     virtual int64_t Position() const override
     {
-      return m_activeLength + m_inputHandle.GetPosition();
+      int64_t activeLength;
+      {
+        std::unique_lock<std::mutex> lock(m_prefetchLock);
+        activeLength = m_activeLength;
+      }
+      return activeLength + m_activeHandle->GetPosition() - static_cast<int64_t>(m_prefetchData.size() - m_prefetchRead);
     }
 
     virtual ssize_t Read(byte *buffer, size_t length) override;
@@ -95,6 +158,8 @@ namespace timeshift {
 
     virtual bool GetStreamInfo() override;
 
+    virtual void Prefetch() override;
+
     virtual PVR_ERROR GetStreamTimes(kodi::addon::PVRStreamTimes& times) override;
   };
 }
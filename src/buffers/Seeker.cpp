@@ -17,6 +17,8 @@ bool Seeker::InitSeek(int64_t offset, int whence)
   int64_t temp;
   m_xStreamOffset = m_iBlockOffset = 0;
   m_bSeeking = m_bSeekBlockRequested = m_bSeekBlockReceived = m_streamPositionSet = false;
+  m_pendingPosition = -1;
+  m_pendingOffset = 0;
 
   if (whence == SEEK_SET)
   {
@@ -46,7 +48,7 @@ bool Seeker::InitSeek(int64_t offset, int whence)
   return true;
 }
 
-bool Seeker::PreprocessSeek()
+bool Seeker::PreprocessSeek(int reserved)
 {
   kodi::Log(ADDON_LOG_DEBUG, "PreprocessSeek()");
 
@@ -54,8 +56,9 @@ bool Seeker::PreprocessSeek()
   int64_t curStreamPtr = m_pSd->streamPosition.load();
   int curOffset = curStreamPtr % m_pSd->inputBlockSize;
   int64_t curBlock = curStreamPtr - curOffset;
-  // Moving within the same block (happens at every playback start)
-  if (curBlock == m_xStreamOffset)
+  // Moving within the same block (happens at every playback start), unless moving
+  // back would leave no room for the payload being received
+  if (curBlock == m_xStreamOffset && m_cirBuf->BytesFree() + (m_iBlockOffset - curOffset) >= reserved)
   {  // We're in the same block!
     int moveOffset = m_iBlockOffset - curOffset;
     kodi::Log(ADDON_LOG_DEBUG, "%s:%d: curBlock: %lli, curOffset: %d, moveBack: %d", __FUNCTION__, __LINE__, curBlock, curOffset, moveOffset);
@@ -91,9 +94,21 @@ bool Seeker::PreprocessSeek()
       }
     }
     else
-    {  // Only seek backwards we can optimize was handled already
-      kodi::Log(ADDON_LOG_DEBUG, "%s:%d:", __FUNCTION__, __LINE__);
-      do_seek = true;
+    {  // seek backwards, served from the retained history if it reaches that far
+      int64_t seekTarget = m_xStreamOffset + m_iBlockOffset;
+      int64_t seekBack = curStreamPtr - seekTarget;
+      kodi::Log(ADDON_LOG_DEBUG, "%s:%d: back %lli, history %d", __FUNCTION__, __LINE__, seekBack, m_cirBuf->BytesHistory());
+      // moving the tail back shrinks the free space, which must still hold the payload being received
+      if (seekBack <= m_cirBuf->BytesHistory() && m_cirBuf->BytesFree() - seekBack >= reserved)
+      {
+        m_pSd->streamPosition.store(seekTarget);
+        m_cirBuf->AdjustBytes(-(int )seekBack);
+        m_bSeeking = false;
+      }
+      else
+      {
+        do_seek = true;
+      }
     }
   }
   kodi::Log(ADDON_LOG_DEBUG, "PreprocessSeek() returning %d", do_seek);
@@ -131,8 +146,9 @@ bool Seeker::PostprocessSeek(int64_t blockNo)
     {
       if (!m_streamPositionSet)
       {
-        m_pSd->streamPosition.store(m_xStreamOffset + m_iBlockOffset);
-        m_cirBuf->AdjustBytes(m_iBlockOffset);
+        // the buffer starts at the seek block, the reader skips to the offset in it
+        m_pendingPosition = m_xStreamOffset + m_iBlockOffset;
+        m_pendingOffset = m_iBlockOffset;
         m_streamPositionSet = true;
         kodi::Log(ADDON_LOG_DEBUG, "%s:%d - m_xStreamOffset: %llu, m_iBlockOffset: %d", __FUNCTION__, __LINE__, m_xStreamOffset, m_iBlockOffset);
       }
@@ -154,3 +170,15 @@ bool Seeker::PostprocessSeek(int64_t blockNo)
   }
   return retVal;
 }
+
+bool Seeker::ApplySeekPosition()
+{
+  if (m_pendingPosition < 0)
+    return false;
+  m_pSd->streamPosition.store(m_pendingPosition);
+  m_cirBuf->AdjustBytes(m_pendingOffset);
+  kodi::Log(ADDON_LOG_DEBUG, "%s:%d - position: %lli, offset: %d", __FUNCTION__, __LINE__, m_pendingPosition, m_pendingOffset);
+  m_pendingPosition = -1;
+  m_pendingOffset = 0;
+  return true;
+}
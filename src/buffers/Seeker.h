@@ -22,16 +22,28 @@ namespace timeshift {
   public:
     Seeker(session_data_t *sd, CircularBuffer *cirBuf) :
       m_pSd(sd), m_cirBuf(cirBuf), m_xStreamOffset(0), m_iBlockOffset(0), m_bSeeking(false),
-      m_bSeekBlockRequested(false), m_bSeekBlockReceived(false), m_streamPositionSet(false) {}
+      m_bSeekBlockRequested(false), m_bSeekBlockReceived(false), m_streamPositionSet(false), m_pendingPosition(-1), m_pendingOffset(0) {}
     ~Seeker() {}
     bool InitSeek(int64_t offset, int whence);
     bool Active() { return m_bSeeking; }
     bool BlockRequested() { return m_bSeekBlockRequested; }
-    bool PreprocessSeek();
+    /**
+     * @param reserved ring space a payload is being received into, a move back
+     * that would take it away is done as a normal seek instead
+     */
+    bool PreprocessSeek(int reserved = 0);
     void ProcessRequests();
     bool PostprocessSeek(int64_t);
+    /**
+     * Consumer side, move the read position to the seek target once
+     * PostprocessSeek() has found it in the buffer. The producer only records
+     * the target, the tail of the buffer is never moved from its thread.
+     * @return true if the position was moved
+     */
+    bool ApplySeekPosition();
+    bool SeekPositionPending() { return m_pendingPosition >= 0; }
     int64_t SeekStreamOffset()  { if (m_bSeeking) return m_xStreamOffset; return -1; }
-    void Clear() { m_xStreamOffset = 0; m_iBlockOffset = 0; m_bSeeking = m_bSeekBlockRequested = m_bSeekBlockReceived = m_streamPositionSet = false; }
+    void Clear() { m_xStreamOffset = 0; m_iBlockOffset = 0; m_bSeeking = m_bSeekBlockRequested = m_bSeekBlockReceived = m_streamPositionSet = false; m_pendingPosition = -1; m_pendingOffset = 0; }
 
 
   private:
@@ -43,6 +55,8 @@ namespace timeshift {
     bool             m_bSeekBlockRequested;
     bool             m_bSeekBlockReceived;
     bool             m_streamPositionSet;
+    int64_t          m_pendingPosition;
+    int32_t          m_pendingOffset;
 
   };
 }
@@ -0,0 +1,153 @@
+/*
+ *  Copyright (C) 2020 Team Kodi
+ *  https://kodi.tv
+ *
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *  See LICENSE.md for more information.
+ */
+
+#include "SpillFile.h"
+#include <kodi/General.h>
+#include <kodi/tools/StringUtils.h>
+
+using namespace timeshift;
+
+bool SpillFile::Open(int blockSize, int capacityMB)
+{
+  // a previous session's writer thread and file go first
+  Close();
+  std::unique_lock<std::mutex> lock(m_mutex);
+  const int slots = static_cast<int>((static_cast<int64_t>(capacityMB) << 20) / blockSize);
+  if (slots <= 0)
+    return false;
+
+  if (!kodi::vfs::DirectoryExists(SPILL_FILE_FOLDER))
+    kodi::vfs::CreateDirectory(SPILL_FILE_FOLDER);
+  // one file per instance, a second client profile may be timeshifting too
+  m_fileName = kodi::tools::StringUtils::Format("%stimeshift-%p.spill", SPILL_FILE_FOLDER, static_cast<void*>(this));
+  if (!m_writer.OpenFileForWrite(m_fileName, true) || !m_reader.OpenFile(m_fileName))
+  {
+    kodi::Log(ADDON_LOG_ERROR, "SpillFile: cannot open %s", m_fileName.c_str());
+    m_writer.Close();
+    kodi::vfs::DeleteFile(m_fileName);
+    return false;
+  }
+  m_blockSize = blockSize;
+  m_slots.assign(slots, -1);
+  m_stopping = false;
+  m_thread = std::thread([this] { Writer(); });
+  kodi::Log(ADDON_LOG_DEBUG, "SpillFile: %d slots of %d bytes in %s", slots, blockSize, m_fileName.c_str());
+  return true;
+}
+
+void SpillFile::Close()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  if (m_blockSize == 0)
+    return;
+  // queued blocks are dropped with the file
+  m_stopping = true;
+  m_pending.clear();
+  m_queued.notify_all();
+  lock.unlock();
+  if (m_thread.joinable())
+    m_thread.join();
+  lock.lock();
+  m_reader.Close();
+  m_writer.Close();
+  kodi::vfs::DeleteFile(m_fileName);
+  m_blockSize = 0;
+  m_slots.clear();
+}
+
+bool SpillFile::Contains(int64_t offset) const
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  if (m_blockSize == 0)
+    return false;
+  if (m_slots[Slot(offset)] == offset)
+    return true;
+  for (const auto& pending : m_pending)
+  {
+    if (pending.offset == offset)
+      return true;
+  }
+  return false;
+}
+
+void SpillFile::Store(int64_t offset, const byte *first, int firstLength, const byte *second, int secondLength)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  if (m_blockSize == 0 || m_stopping || firstLength + secondLength != m_blockSize || offset % m_blockSize != 0)
+    return;
+  if (m_slots[Slot(offset)] == offset)
+    return;
+  for (const auto& pending : m_pending)
+  {
+    if (pending.offset == offset)
+      return;
+  }
+  if (m_pending.size() >= SPILL_QUEUE_BLOCKS)
+  {
+    kodi::Log(ADDON_LOG_DEBUG, "SpillFile: writer behind, block %lld not kept", offset);
+    return;
+  }
+
+  m_pending.push_back({offset, std::vector<byte>(first, first + firstLength)});
+  if (secondLength > 0)
+    m_pending.back().data.insert(m_pending.back().data.end(), second, second + secondLength);
+  m_queued.notify_one();
+}
+
+void SpillFile::Writer()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (true)
+  {
+    m_queued.wait(lock, [this] { return m_stopping || !m_pending.empty(); });
+    if (m_stopping)
+      return;
+    Pending block = std::move(m_pending.front());
+    m_pending.pop_front();
+    const int slot = Slot(block.offset);
+    // the slot is invalid until the new block is completely written
+    m_slots[slot] = -1;
+
+    lock.unlock();
+    const bool written = m_writer.Seek(static_cast<int64_t>(slot) * m_blockSize, SEEK_SET) >= 0 &&
+      m_writer.Write(block.data.data(), block.data.size()) == static_cast<ssize_t>(block.data.size());
+    lock.lock();
+
+    if (!written)
+      kodi::Log(ADDON_LOG_ERROR, "SpillFile: write of block %lld failed", block.offset);
+    else if (!m_stopping && m_slots[slot] == -1)
+      m_slots[slot] = block.offset;
+  }
+}
+
+bool SpillFile::Load(int64_t offset, std::vector<byte>& data)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  if (m_blockSize == 0)
+    return false;
+  for (const auto& pending : m_pending)
+  {
+    if (pending.offset == offset)
+    {
+      data = pending.data;
+      return true;
+    }
+  }
+  if (m_slots[Slot(offset)] != offset)
+    return false;
+
+  data.resize(m_blockSize);
+  if (m_reader.Seek(static_cast<int64_t>(Slot(offset)) * m_blockSize, SEEK_SET) < 0 ||
+      m_reader.Read(data.data(), m_blockSize) != m_blockSize)
+  {
+    kodi::Log(ADDON_LOG_ERROR, "SpillFile: read of block %lld failed", offset);
+    m_slots[Slot(offset)] = -1;
+    return false;
+  }
+  return true;
+}
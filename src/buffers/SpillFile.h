@@ -0,0 +1,78 @@
+/*
+ *  Copyright (C) 2020 Team Kodi
+ *  https://kodi.tv
+ *
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *  See LICENSE.md for more information.
+ */
+
+#pragma once
+
+#include <kodi/Filesystem.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+#define SPILL_FILE_FOLDER "special://temp/pvr.nextpvr/"
+// blocks waiting for the writer thread, more than this are not kept
+#define SPILL_QUEUE_BLOCKS 16
+
+namespace timeshift {
+
+  /**
+   * Local disk copy of the timeshift blocks received this session.
+   *
+   * The file is a fixed number of block sized slots, a block lives in slot
+   * (offset / blockSize) % slots so a stream longer than the file simply
+   * overwrites its oldest blocks. Only the index of which offset is in
+   * which slot is kept in memory.
+   *
+   * Blocks are written by a thread of their own so a slow disk never holds
+   * up the input thread, when it falls behind by more than
+   * SPILL_QUEUE_BLOCKS further blocks are simply not kept.
+   */
+  class ATTRIBUTE_HIDDEN SpillFile
+  {
+  public:
+    bool Open(int blockSize, int capacityMB);
+    void Close();
+    bool IsOpen() const { return m_blockSize != 0; }
+
+    bool Contains(int64_t offset) const;
+
+    /**
+     * Keep a complete block, given as up to two pieces. The data is copied
+     * and queued for the writer thread.
+     */
+    void Store(int64_t offset, const byte *first, int firstLength, const byte *second, int secondLength);
+
+    /**
+     * Read a block kept earlier.
+     */
+    bool Load(int64_t offset, std::vector<byte>& data);
+
+  private:
+    int Slot(int64_t offset) const { return static_cast<int>((offset / m_blockSize) % m_slots.size()); }
+    void Writer();
+
+    struct Pending
+    {
+      int64_t offset;
+      std::vector<byte> data;
+    };
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_queued;
+    std::deque<Pending> m_pending;
+    std::thread m_thread;
+    bool m_stopping = false;
+    kodi::vfs::CFile m_writer;
+    kodi::vfs::CFile m_reader;
+    std::string m_fileName;
+    int m_blockSize = 0;
+    std::vector<int64_t> m_slots;
+  };
+}
@@ -16,17 +16,34 @@
 
 #include "TimeshiftBuffer.h"
 #include <kodi/General.h>
+#include <map>
+#include <vector>
 
 using namespace timeshift;
 
 
 const int TimeshiftBuffer::INPUT_READ_LENGTH = 32768;
+const int TimeshiftBuffer::MAX_READ_LENGTH = 262144;
 const int TimeshiftBuffer::BUFFER_BLOCKS = 48;
-const int TimeshiftBuffer::WINDOW_SIZE = std::max(6, (BUFFER_BLOCKS/2));
+const int TimeshiftBuffer::MIN_WINDOW_SIZE = 6;
+const int TimeshiftBuffer::WINDOW_SIZE = std::max(MIN_WINDOW_SIZE, (BUFFER_BLOCKS/2));
+const int TimeshiftBuffer::BLOCKS_PER_SECOND = 4;
+const int TimeshiftBuffer::BUFFER_SECONDS = 6;
+const int TimeshiftBuffer::REQUEST_LENGTH = 48;
+const int TimeshiftBuffer::POLL_INTERVAL = 250;
+
+namespace
+{
+  // Bitrate seen the last time each channel was watched, used to size the next session.
+  std::map<int, int> channelBytesPerSecond;
+  std::mutex channelLock;
+}
 
 TimeshiftBuffer::TimeshiftBuffer()
-  : Buffer(), m_circularBuffer(INPUT_READ_LENGTH * BUFFER_BLOCKS),
-    m_seek(&m_sd, &m_circularBuffer), m_streamingclient(nullptr), m_CanPause(true)
+  : Buffer(), m_circularBuffer(INPUT_READ_LENGTH * (BUFFER_BLOCKS + 1), INPUT_READ_LENGTH),
+    m_seek(&m_sd, &m_circularBuffer), m_streamingclient(nullptr), m_CanPause(true), m_rtt(0),
+    m_parser(INPUT_READ_LENGTH), m_blockInRing(false), m_nextBlock(-1),
+    m_readerWaiting(false), m_writerWaiting(false), m_ended(false), m_seekPending(false)
 {
   kodi::Log(ADDON_LOG_DEBUG, "TimeshiftBuffer created!");
   m_sd.lastKnownLength.store(0);
@@ -34,13 +51,15 @@ TimeshiftBuffer::TimeshiftBuffer()
   m_sd.ptsEnd.store(0);
   m_sd.tsbStart.store(0);
   m_sd.streamPosition.store(0);
-  m_sd.iBytesPerSecond = 0;
+  m_sd.iBytesPerSecond.store(0);
   m_sd.sessionStartTime.store(0);
   m_sd.tsbStartTime.store(0);
   m_sd.tsbRollOff = 0;
   m_sd.lastBlockBuffered = 0;
   m_sd.lastBufferTime = 0;
   m_sd.currentWindowSize = 0;
+  m_sd.windowSize = WINDOW_SIZE;
+  m_sd.inputBlockSize = INPUT_READ_LENGTH;
   m_sd.requestNumber = 0;
   m_sd.requestBlock = 0;
   m_sd.isPaused = false;
@@ -66,21 +85,23 @@ bool TimeshiftBuffer::Open(const std::string inputUrl)
     return false;
   }
 
+  auto connectStart = std::chrono::steady_clock::now();
   if (!m_streamingclient->connect(m_settings.m_hostname, m_settings.m_port))
   {
     kodi::Log(ADDON_LOG_ERROR, "%s:%d: Could not connect to NextPVR backend (%s:%d) for streaming", __FUNCTION__, __LINE__, m_settings.m_hostname.c_str(), m_settings.m_port);
     return false;
   }
+  m_rtt = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - connectStart).count());
+  SetGeometry();
 
-  m_streamingclient->send(inputUrl.c_str(), strlen(inputUrl.c_str()));
-
-  char line[256];
-
-  sprintf(line, "Connection: close\r\n");
-  m_streamingclient->send(line, strlen(line));
+  // the range requests are small and latency bound, don't let Nagle hold them back
+  int noDelay = 1;
+  if (m_streamingclient->SetSocketOption(IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<char*>(&noDelay), sizeof(noDelay)))
+    kodi::Log(ADDON_LOG_ERROR, "%s:%d: Could not set TCP_NODELAY", __FUNCTION__, __LINE__);
 
-  sprintf(line, "\r\n");
-  m_streamingclient->send(line, strlen(line));
+  // so the whole request header goes out in one segment
+  std::string header = inputUrl + "Connection: close\r\n\r\n";
+  m_streamingclient->send(header.c_str(), header.length());
 
   //m_currentLivePosition = 0;
 
@@ -125,27 +146,26 @@ bool TimeshiftBuffer::Open(const std::string inputUrl)
   }
 
   kodi::Log(ADDON_LOG_DEBUG, "TSB: Opened streaming connection!");
+  m_ended.store(false);
   // Start the input thread
   m_inputThread = std::thread([this]()
   {
     ConsumeInput();
   });
 
-  m_tsbThread = std::thread([this]()
-  {
-    TSBTimerProc();
-  });
-
   kodi::Log(ADDON_LOG_DEBUG, "Open grabbing lock");
   std::unique_lock<std::mutex> lock(m_mutex);
   kodi::Log(ADDON_LOG_DEBUG, "Open Continuing");
-  int minLength = BUFFER_BLOCKS * INPUT_READ_LENGTH;
+  int minLength = m_circularBuffer.Size();
   kodi::Log(ADDON_LOG_DEBUG, "Open waiting for %d bytes to buffer", minLength);
+  m_readerWaiting.store(true);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
   m_reader.wait_for(lock, std::chrono::seconds(1),
                     [this, minLength]()
   {
     return m_circularBuffer.BytesAvailable() >= minLength;
   });
+  m_readerWaiting.store(false);
   kodi::Log(ADDON_LOG_DEBUG, "Open Continuing %d / %d", m_circularBuffer.BytesAvailable(), minLength);
   // Make sure data is flowing, before declaring success.
   if (m_circularBuffer.BytesAvailable() != 0)
@@ -160,14 +180,31 @@ void TimeshiftBuffer::Close()
   // Wait for the input thread to terminate
   Buffer::Close();
 
-  m_writer.notify_one();  // In case it's sleeping.
+  if (m_sd.iBytesPerSecond.load() > 0)
+  {
+    std::unique_lock<std::mutex> lock(channelLock);
+    channelBytesPerSecond[m_channel_id] = m_sd.iBytesPerSecond.load();
+  }
+
+  RingStats& stats = m_circularBuffer.Stats();
+  if (stats.bytesIn.load() != 0)
+  {
+    kodi::Log(ADDON_LOG_DEBUG, "TimeshiftBuffer stats: in %llu out %llu wraps %llu adjusts %llu rejected %llu, blocks requested %llu received %llu held %llu from disk %llu, underflows %llu",
+              stats.bytesIn.load(), stats.bytesOut.load(), stats.wraps.load(), stats.adjusts.load(), stats.rejected.load(),
+              m_blocksRequested.load(), m_blocksReceived.load(), m_blocksHeld.load(), m_blocksSpilled.load(), m_underflows.load());
+    kodi::Log(ADDON_LOG_DEBUG, "TimeshiftBuffer block wait: %s", m_blockWait.ToString().c_str());
+  }
+
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_writer.notify_one();  // In case it's sleeping.
+  }
 
   if (m_inputThread.joinable())
     m_inputThread.join();
 
-  if (m_tsbThread.joinable())
-    m_tsbThread.join();
-
+  m_bitrate.Reset();
+  m_index.Reset();
 
   if (m_streamingclient)
   {
@@ -185,16 +222,29 @@ void TimeshiftBuffer::Close()
   m_sd.sessionStartTime.store(0);
   m_sd.tsbStartTime.store(0);
   m_sd.tsbRollOff = 0;
-  m_sd.iBytesPerSecond = 0;
+  m_sd.iBytesPerSecond.store(0);
   m_sd.lastBlockBuffered = 0;
   m_sd.lastBufferTime = 0;
   m_sd.streamPosition.store(0);
   m_sd.currentWindowSize = 0;
+  m_sd.windowSize = WINDOW_SIZE;
   m_sd.inputBlockSize = INPUT_READ_LENGTH;
   m_sd.isPaused = false;
   m_sd.pauseStart = 0;
   m_sd.lastPauseAdjust = 0;
   m_circularBuffer.Reset();
+  stats.Clear();
+  m_blocksRequested.store(0);
+  m_blocksReceived.store(0);
+  m_underflows.store(0);
+  m_blockWait.Clear();
+  m_parser.Reset();
+  m_earlyBlocks.clear();
+  m_spill.Close();
+  m_nextBlock = -1;
+  m_ended.store(false);
+  m_blocksHeld.store(0);
+  m_blocksSpilled.store(0);
 
   Reset();
 }
@@ -209,38 +259,88 @@ void TimeshiftBuffer::Reset()
 
   // Reset
   m_seek.Clear();
+  m_seekPending.store(false);
 
 }
 
 ssize_t TimeshiftBuffer::Read(byte *buffer, size_t length)
 {
   int bytesRead = 0;
-  std::unique_lock<std::mutex> lock(m_mutex);
-  kodi::Log(ADDON_LOG_DEBUG, "TimeshiftBuffer::Read() %d @ %lli", length, m_sd.streamPosition.load());
-
-  // Wait until we have enough data
+  TRACE_BUFFER("TimeshiftBuffer::Read() %d @ %lli", length, m_sd.streamPosition.load());
 
-  if (! m_reader.wait_for(lock, std::chrono::seconds(m_readTimeout),
-    [this, length]()
+  // After a seek that refetches, the buffer starts at the seek block and the input thread
+  // only records where in it the stream resumes. The tail is moved here, by the reader.
+  if (m_seekPending.load())
   {
-    return m_circularBuffer.BytesAvailable() >= (int )length;
-  }))
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_readerWaiting.store(true);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    m_reader.wait_for(lock, std::chrono::seconds(m_readTimeout), [this]()
+    {
+      return m_ended.load() || m_seek.SeekPositionPending();
+    });
+    m_readerWaiting.store(false);
+    if (!m_seek.ApplySeekPosition())
+    {
+      kodi::Log(ADDON_LOG_DEBUG, "Timeout waiting for the seek block");
+      return 0;
+    }
+    m_seekPending.store(false);
+  }
+
+  // Only lock if we have to wait for data, the input thread never moves the tail.
+  if (m_circularBuffer.BytesAvailable() < (int )length)
   {
-    kodi::Log(ADDON_LOG_DEBUG, "Timeout waiting for bytes!! [buffer underflow]");
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_readerWaiting.store(true);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (! m_reader.wait_for(lock, std::chrono::seconds(m_readTimeout),
+      [this, length]()
+    {
+      return m_ended.load() || m_circularBuffer.BytesAvailable() >= (int )length;
+    }))
+    {
+      kodi::Log(ADDON_LOG_DEBUG, "Timeout waiting for bytes!! [buffer underflow]");
+      RingStats::Add(m_underflows);
+    }
+    m_readerWaiting.store(false);
   }
+  // once the backend has gone the rest of the buffer is drained, then Read() reports end of stream
   bytesRead = m_circularBuffer.ReadBytes(buffer, length);
-  m_sd.streamPosition.fetch_add(length);
-  if (m_circularBuffer.BytesFree() >= INPUT_READ_LENGTH)
+  if (bytesRead == 0 && m_ended.load())
+    return 0;
+  m_sd.streamPosition.fetch_add(bytesRead);
+  if (m_circularBuffer.BytesFree() >= m_sd.inputBlockSize)
   {
-    // wake the filler thread if there's room in the buffer
-    m_writer.notify_one();
+    // wake the filler thread if it was waiting for room in the buffer
+    WakeWriter();
   }
 
   if (bytesRead != length)
-    kodi::Log(ADDON_LOG_DEBUG, "Read returns %d for %d request.", bytesRead, length);
+    TRACE_BUFFER("Read returns %d for %d request.", bytesRead, length);
   return bytesRead;
 }
 
+void TimeshiftBuffer::WakeReader()
+{
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (m_readerWaiting.load())
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_reader.notify_one();
+  }
+}
+
+void TimeshiftBuffer::WakeWriter()
+{
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (m_writerWaiting.load())
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_writer.notify_one();
+  }
+}
+
 //
 // When seeking, we're going to have to flush the buffers already in transit (already requested)
 // and only make data available when we get the seeked-to block in.
@@ -250,8 +350,14 @@ int64_t TimeshiftBuffer::Seek(int64_t position, int whence)
 {
   bool sleep = false;
   kodi::Log(ADDON_LOG_DEBUG, "TimeshiftBuffer::Seek()");
-  int64_t highLimit = m_sd.lastKnownLength.load() - m_sd.iBytesPerSecond;
-  int64_t lowLimit = m_sd.tsbStart.load() + (m_sd.iBytesPerSecond << 2);  // Add Roughly 4 seconds to account for estimating the start.
+  UpdateStreamTimes();
+  const int bytesPerSecond = m_sd.iBytesPerSecond.load();
+  int64_t highLimit = m_sd.lastKnownLength.load() - bytesPerSecond;
+  int64_t lowLimit = m_sd.tsbStart.load() + (bytesPerSecond << 2);  // Add Roughly 4 seconds to account for estimating the start.
+  // where the start has been indexed a second is enough to stay clear of the backend trimming it
+  int64_t indexedStart = m_index.OffsetAt(static_cast<double>(m_sd.tsbStartTime.load() - m_sd.sessionStartTime.load() + 1));
+  if (indexedStart >= 0)
+    lowLimit = indexedStart;
 
   if (position > highLimit)
   {
@@ -263,6 +369,7 @@ int64_t TimeshiftBuffer::Seek(int64_t position, int whence)
     kodi::Log(ADDON_LOG_ERROR, "Seek requested to %lld, limiting to %lld\n", position, lowLimit);
     position = lowLimit;
   }
+  position = m_index.Align(position);
 
   {
     std::unique_lock<std::mutex> lock(m_mutex);
@@ -271,8 +378,18 @@ int64_t TimeshiftBuffer::Seek(int64_t position, int whence)
     kodi::Log(ADDON_LOG_DEBUG, "Seek:  %d  %d  %llu %llu", SEEK_SET, whence, m_sd.streamPosition.load(), position);
     if ((whence == SEEK_SET) && (position == m_sd.streamPosition.load()))
       return position;
+    if (m_ended.load())
+    {
+      kodi::Log(ADDON_LOG_ERROR, "Seek after the streaming connection ended");
+      return -1;
+    }
     m_seek.InitSeek(position, whence);
-    if (m_seek.PreprocessSeek())
+    // a payload received straight into the ring owns that free space until it is committed
+    const int reserved = (m_blockInRing && m_parser.GetState() == LiveShiftParser::WantPayload) ? m_parser.Current().size : 0;
+    const bool refetch = m_seek.PreprocessSeek(reserved);
+    // the buffer was emptied to receive the seek block, Read() waits for its position
+    m_seekPending.store(refetch || m_seek.BlockRequested());
+    if (refetch)
     {
       internalRequestBlocks();
       m_writer.notify_one(); // wake consumer.
@@ -283,7 +400,8 @@ int64_t TimeshiftBuffer::Seek(int64_t position, int whence)
   {
     std::unique_lock<std::mutex> sLock(m_sLock);
     kodi::Log(ADDON_LOG_DEBUG, "Seek Waiting");
-    m_seeker.wait(sLock);
+    if (!m_ended.load())
+      m_seeker.wait(sLock);
   }
   kodi::Log(ADDON_LOG_DEBUG, "Seek() returning %lli", position);
   return position;
@@ -291,6 +409,7 @@ int64_t TimeshiftBuffer::Seek(int64_t position, int whence)
 
 PVR_ERROR TimeshiftBuffer::GetStreamTimes(kodi::addon::PVRStreamTimes& stimes)
 {
+  UpdateStreamTimes();
   stimes.SetStartTime(m_sd.sessionStartTime.load());
   stimes.SetPTSStart(0);
   stimes.SetPTSBegin(m_sd.ptsBegin.load());
@@ -303,10 +422,61 @@ PVR_ERROR TimeshiftBuffer::GetStreamTimes(kodi::addon::PVRStreamTimes& stimes)
 PVR_ERROR TimeshiftBuffer::GetStreamReadChunkSize(int& chunksize)
 {
   // Make this a tunable parameter?
-  chunksize = TimeshiftBuffer::INPUT_READ_LENGTH;
+  chunksize = m_sd.inputBlockSize;
   return PVR_ERROR_NO_ERROR;
 }
 
+void TimeshiftBuffer::SetGeometry()
+{
+  int bytesPerSecond = 0;
+  {
+    std::unique_lock<std::mutex> lock(channelLock);
+    auto it = channelBytesPerSecond.find(m_channel_id);
+    if (it != channelBytesPerSecond.end())
+      bytesPerSecond = it->second;
+  }
+
+  int blockSize = INPUT_READ_LENGTH;
+  int bufferSize = INPUT_READ_LENGTH * BUFFER_BLOCKS;
+  if (bytesPerSecond > 0)
+  {
+    // a few blocks per second of stream, in 16K steps
+    blockSize = ((bytesPerSecond / BLOCKS_PER_SECOND + 16383) / 16384) * 16384;
+    blockSize = std::min(std::max(blockSize, INPUT_READ_LENGTH), MAX_READ_LENGTH);
+    bufferSize = bytesPerSecond * BUFFER_SECONDS;
+  }
+  bufferSize = std::min(std::max(bufferSize, m_settings.m_timeshiftMinBuffer << 20), m_settings.m_timeshiftMaxBuffer << 20);
+  int blocks = std::max(bufferSize / blockSize, MIN_WINDOW_SIZE * 2);
+
+  // keep already read data for short backward seeks, at least the block being read
+  int historyRate = bytesPerSecond > 0 ? bytesPerSecond : bufferSize / BUFFER_SECONDS;
+  int64_t history = static_cast<int64_t>(historyRate) * m_settings.m_timeshiftHistorySeconds;
+  int historyBlocks = static_cast<int>(std::min<int64_t>((history + blockSize - 1) / blockSize, (m_settings.m_timeshiftMaxBuffer << 20) / blockSize));
+  historyBlocks = std::max(historyBlocks, 1);
+
+  m_sd.inputBlockSize = blockSize;
+  m_parser.SetMaxPayload(blockSize);
+  if (m_settings.m_timeshiftSpill)
+    m_spill.Open(blockSize, m_settings.m_timeshiftSpillSize);
+  m_circularBuffer.Resize(blockSize * (blocks + historyBlocks), blockSize * historyBlocks);
+  m_sd.windowSize = WindowSize(bytesPerSecond);
+  kodi::Log(ADDON_LOG_DEBUG, "TimeshiftBuffer geometry: %d B/s, rtt %d ms, block %d, buffer %d blocks, history %d blocks, window %d",
+            bytesPerSecond, m_rtt, blockSize, blocks, historyBlocks, m_sd.windowSize);
+}
+
+int TimeshiftBuffer::WindowSize(int bytesPerSecond) const
+{
+  const int blocks = m_circularBuffer.Size() / m_sd.inputBlockSize;
+  int window = WINDOW_SIZE;
+  if (bytesPerSecond > 0)
+  {
+    // cover the data that arrives during a round trip twice over
+    int64_t inFlight = static_cast<int64_t>(bytesPerSecond) * m_rtt / 1000;
+    window = MIN_WINDOW_SIZE + static_cast<int>((2 * inFlight) / m_sd.inputBlockSize);
+  }
+  return std::max(MIN_WINDOW_SIZE, std::min(window, std::min(m_settings.m_timeshiftMaxWindow, blocks / 2)));
+}
+
 void TimeshiftBuffer::RequestBlocks()
 {
   std::unique_lock<std::mutex> lock(m_mutex);
@@ -319,129 +489,303 @@ void TimeshiftBuffer::internalRequestBlocks()
 
   m_seek.ProcessRequests(); // Handle outstanding seek request, if there is one.
 
-  // send read request (using a basic sliding window protocol)
-  for (int i = m_sd.currentWindowSize; i < WINDOW_SIZE; i++)
+  // follow the bitrate, the window only grows or shrinks as requests complete
+  const int bytesPerSecond = m_sd.iBytesPerSecond.load();
+  if (bytesPerSecond > 0)
+    m_sd.windowSize = WindowSize(bytesPerSecond);
+
+  // build read requests (using a basic sliding window protocol), each one is a
+  // fixed 48 byte record and the whole window goes out in a single send
+  const int count = m_sd.windowSize - m_sd.currentWindowSize;
+  if (count <= 0)
+    return;
+  std::vector<char> requests;
+  requests.reserve(count * REQUEST_LENGTH);
+  while (m_sd.currentWindowSize < m_sd.windowSize)
   {
     int64_t blockOffset = m_sd.requestBlock;
-    char request[48];
-    memset(request, 0, sizeof(request));
-    snprintf(request, sizeof(request), "Range: bytes=%llu-%llu-%d", blockOffset, (blockOffset+INPUT_READ_LENGTH), m_sd.requestNumber);
-    kodi::Log(ADDON_LOG_DEBUG, "sending request: %s\n", request);
-    if (m_streamingclient->send(request, sizeof(request)) != sizeof(request))
+    if (m_earlyBlocks.count(blockOffset))
     {
-      kodi::Log(ADDON_LOG_DEBUG, "NOT ALL BYTES SENT!");
+      // already here, waiting for its turn
+      m_sd.requestBlock += m_sd.inputBlockSize;
+      continue;
+    }
+    if (m_spill.Contains(blockOffset))
+    {
+      // watched before, take it from the local copy. Only a few at a time,
+      // the rest is picked up as these are consumed.
+      if ((int )m_earlyBlocks.size() >= m_sd.windowSize / 2)
+        break;
+      if (m_spill.Load(blockOffset, m_earlyBlocks[blockOffset]))
+      {
+        RingStats::Add(m_blocksSpilled);
+        m_sd.requestBlock += m_sd.inputBlockSize;
+        continue;
+      }
+      m_earlyBlocks.erase(blockOffset);
     }
+    requests.resize(requests.size() + REQUEST_LENGTH, 0);
+    char *request = requests.data() + requests.size() - REQUEST_LENGTH;
+    snprintf(request, REQUEST_LENGTH, "Range: bytes=%llu-%llu-%d", blockOffset, (blockOffset+m_sd.inputBlockSize), m_sd.requestNumber);
+    TRACE_BUFFER("sending request: %s", request);
 
-    m_sd.requestBlock += INPUT_READ_LENGTH;
+    RingStats::Add(m_blocksRequested);
+    m_sd.requestBlock += m_sd.inputBlockSize;
     m_sd.requestNumber++;
     m_sd.currentWindowSize++;
   }
+
+  size_t sent = 0;
+  while (sent < requests.size())
+  {
+    int status = m_streamingclient->send(requests.data() + sent, requests.size() - sent);
+    if (status <= 0)
+    {
+      kodi::Log(ADDON_LOG_DEBUG, "NOT ALL BYTES SENT!");
+      break;
+    }
+    sent += status;
+  }
 }
 
-uint32_t TimeshiftBuffer::WatchForBlock(byte *buffer, uint64_t *block)
+uint32_t TimeshiftBuffer::WatchForBlock(uint64_t *block)
 {
 //  kodi::Log(ADDON_LOG_DEBUG, "TimeshiftBuffer::WatchForBlock()");
 
   int64_t watchFor = -1;  // Any (next) block
   uint32_t returnBytes = 0;
-  int retries = WINDOW_SIZE + 1;
   std::unique_lock<std::mutex> lock(m_mutex);
-  if (m_seek.Active())
-  {
-    if (m_seek.BlockRequested())
-    { // Can't watch for blocks that haven't been requested!
-      watchFor = m_seek.SeekStreamOffset();
-      kodi::Log(ADDON_LOG_DEBUG, "%s:%d: watching for bloc %llu", __FUNCTION__, __LINE__, watchFor);
-    }
-    else
-    {
-      return returnBytes;
-    }
+  if (m_seek.Active() && !m_seek.BlockRequested())
+  { // Can't watch for blocks that haven't been requested!
+    return returnBytes;
   }
   //if (watchFor == -1)
   //  kodi::Log(ADDON_LOG_DEBUG, "waiting for next block");
   //else
   //  kodi::Log(ADDON_LOG_DEBUG, "about to wait for block with offset: %llu\n", watchFor);
-  while (retries)
+  auto waitStart = std::chrono::steady_clock::now();
+  bool stallLogged = false;
+  while (m_active)
   {
+    // the block we need may have arrived early, unless the ring space is busy with a payload
+    watchFor = m_seek.Active() ? m_seek.SeekStreamOffset() : m_nextBlock;
+    if (m_parser.GetState() != LiveShiftParser::WantPayload && (returnBytes = TakeEarlyBlock(watchFor, block)))
+      break;
+
     if (!m_streamingclient->is_valid())
     {
       kodi::Log(ADDON_LOG_DEBUG, "about to call receive(), socket is invalid\n");
+      m_ended.store(true);
       return returnBytes;
     }
 
-    if (m_streamingclient->read_ready())
+    // sleep in the kernel until the backend sends something, without holding
+    // the lock so a seek can go ahead meanwhile
+    lock.unlock();
+    int ready = m_streamingclient->wait_readable(POLL_INTERVAL);
+    lock.lock();
+    int64_t waited = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - waitStart).count();
+    if (ready < 0)
+    {
+      kodi::Log(ADDON_LOG_ERROR, "%s:%d: streaming socket failed", __FUNCTION__, __LINE__);
+      m_ended.store(true);
+      return returnBytes;
+    }
+    if (ready == 0)
     {
-      // read response header
-      char response[128];
-      memset(response, 0, sizeof(response));
-      int responseByteCount = m_streamingclient->receive(response, sizeof(response), sizeof(response));
-      kodi::Log(ADDON_LOG_DEBUG, "%s:%d: responseByteCount: %d\n", __FUNCTION__, __LINE__, responseByteCount);
-      if (responseByteCount > 0)
+      if (!stallLogged && waited >= m_readTimeout * 1000)
       {
-        kodi::Log(ADDON_LOG_DEBUG, "%s:%d: got: %s\n", __FUNCTION__, __LINE__, response);
+        kodi::Log(ADDON_LOG_DEBUG, "%s:%d: no data from backend for %lld ms", __FUNCTION__, __LINE__, waited);
+        stallLogged = true;
       }
-      else if (responseByteCount < 0)
+      if (m_seek.Active() && !m_seek.BlockRequested())
+        return returnBytes;
+      continue;
+    }
+    if (m_parser.GetState() == LiveShiftParser::WantHeader)
+    {
+      if (m_parser.HeaderRemaining() == LiveShiftParser::HEADER_LENGTH)
+        m_blockWait.Add(waited);
+
+      // read (the rest of) the response header, a partial header just waits for more
+      int responseByteCount = m_streamingclient->receive(m_parser.HeaderSpace(), m_parser.HeaderRemaining(), nullptr, 0, false);
+      TRACE_BUFFER("%s:%d: responseByteCount: %d", __FUNCTION__, __LINE__, responseByteCount);
+      if (responseByteCount <= 0)
       {
+        kodi::Log(ADDON_LOG_DEBUG, "%s:%d: streaming connection closed (%d)", __FUNCTION__, __LINE__, responseByteCount);
+        m_ended.store(true);
         return 0;
       }
-  #if defined(TARGET_WINDOWS)
-      else if (responseByteCount < 0 && errno == WSAEWOULDBLOCK)
-  #else
-      else if (responseByteCount < 0 && errno == EAGAIN)
-  #endif
+      if (!m_parser.HeaderReceived(responseByteCount))
       {
-        std::this_thread::sleep_for(std::chrono::milliseconds(50));
-        kodi::Log(ADDON_LOG_DEBUG, "got: %d", errno);
-        retries--;
-        continue;
+        // nothing after a bad header can be trusted
+        kodi::Log(ADDON_LOG_ERROR, "%s:%d: lost framing on streaming connection", __FUNCTION__, __LINE__);
+        m_streamingclient->close();
+        m_ended.store(true);
+        return 0;
       }
+      if (m_parser.GetState() != LiveShiftParser::WantPayload)
+        continue;
 
-      // parse response header
-      long long payloadOffset;
-      int payloadSize;
-      long long fileSize;
-      int dummy;
-      sscanf(response, "%llu:%d %llu %d", &payloadOffset, &payloadSize, &fileSize, &dummy);
-      kodi::Log(ADDON_LOG_DEBUG, "PKT_IN: %llu:%d %llu %d", payloadOffset, payloadSize, fileSize, dummy);
-      if (m_sd.lastKnownLength.load() != fileSize)
+      const LiveShiftParser::Block& header = m_parser.Current();
+      TRACE_BUFFER("PKT_IN: %llu:%d %llu %d", header.offset, header.size, header.fileSize, header.request);
+      RingStats::Add(m_blocksReceived);
+      if (m_sd.lastKnownLength.load() != header.fileSize)
       {
-        m_sd.lastKnownLength.store(fileSize);
+        m_sd.lastKnownLength.store(header.fileSize);
       }
+      // UpdateStreamTimes() publishes the new estimate in m_sd
+      if (m_bitrate.AddSample(header.fileSize))
+        TRACE_BUFFER("Bitrate now %d B/s", m_bitrate.BytesPerSecond());
+
+      // the payload goes straight into the free space of the circular buffer,
+      // it only becomes visible to the reader once the block is committed
+      byte *first, *second;
+      int firstLength, secondLength;
+      m_blockInRing = m_circularBuffer.WritableRegions(&first, &firstLength, &second, &secondLength) >= header.size;
+      if (!m_blockInRing)
+        kodi::Log(ADDON_LOG_ERROR, "%s:%d: No room for %d byte block, dropping it", __FUNCTION__, __LINE__, header.size);
+    }
 
-      // read response payload
-      int bytesRead = 0;
-
-      do
+    // read whatever part of the payload has arrived
+    const LiveShiftParser::Block& current = m_parser.Current();
+    const int done = m_parser.PayloadDone();
+    const int remaining = m_parser.PayloadRemaining();
+    int bytesRead;
+    if (m_blockInRing)
+    {
+      // only this thread moves the head, so the regions still start where the block does
+      byte *first, *second;
+      int firstLength, secondLength;
+      m_circularBuffer.WritableRegions(&first, &firstLength, &second, &secondLength);
+      if (done < firstLength)
       {
-        bytesRead = m_streamingclient->receive((char *)buffer, INPUT_READ_LENGTH, payloadSize);
-#if defined(TARGET_WINDOWS)
-      } while (bytesRead < 0 && errno == WSAEWOULDBLOCK);
-#else
-      } while (bytesRead < 0 && errno == EAGAIN);
-#endif
-
-      if ((watchFor == -1) || (payloadOffset == watchFor))
+        int length = std::min(remaining, firstLength - done);
+        bytesRead = m_streamingclient->receive((char *)first + done, length, (char *)second, remaining - length, false);
+      }
+      else
       {
-        if (m_circularBuffer.BytesAvailable() == 0) // Buffer empty!
-          m_sd.streamPosition.store(payloadOffset);
-        *block = payloadOffset;
-        returnBytes = payloadSize;
-        if (m_sd.currentWindowSize > 0)
-          m_sd.currentWindowSize--;
-        kodi::Log(ADDON_LOG_DEBUG, "Returning block %llu for buffering", payloadOffset);
-        break; // We want to buffer this payload.
+        bytesRead = m_streamingclient->receive((char *)second + (done - firstLength), remaining, nullptr, 0, false);
       }
     }
+    else
+    {
+      char discard[16384];
+      bytesRead = m_streamingclient->receive(discard, std::min(remaining, (int )sizeof(discard)), nullptr, 0, false);
+    }
+    if (bytesRead <= 0)
+    {
+      kodi::Log(ADDON_LOG_DEBUG, "%s:%d: streaming connection closed (%d)", __FUNCTION__, __LINE__, bytesRead);
+      m_ended.store(true);
+      return 0;
+    }
+    if (!m_parser.PayloadReceived(bytesRead))
+      continue;
+
+    // the seek state may have changed while the block arrived
+    watchFor = m_seek.Active() ? m_seek.SeekStreamOffset() : m_nextBlock;
+    TRACE_BUFFER("%s:%d: watching for bloc %lld", __FUNCTION__, __LINE__, watchFor);
+
+    if (m_blockInRing && ((watchFor == -1) || (current.offset == watchFor)))
+    {
+      if (m_circularBuffer.BytesAvailable() == 0) // Buffer empty!
+        m_sd.streamPosition.store(current.offset);
+      *block = current.offset;
+      returnBytes = current.size;
+      if (m_sd.currentWindowSize > 0)
+        m_sd.currentWindowSize--;
+      // anything held from before this block is no use any more
+      m_earlyBlocks.erase(m_earlyBlocks.begin(), m_earlyBlocks.lower_bound(current.offset));
+      TRACE_BUFFER("Returning block %llu for buffering", current.offset);
+      break; // We want to buffer this payload.
+    }
+    if (m_blockInRing && current.offset > watchFor && current.offset < m_sd.requestBlock)
+    {
+      // early, keep it until the blocks before it are in
+      HoldEarlyBlock(current.offset, current.size);
+      if (m_sd.currentWindowSize > 0)
+        m_sd.currentWindowSize--;
+    }
+    waitStart = std::chrono::steady_clock::now();
   }
   return returnBytes;
 }
+void TimeshiftBuffer::HoldEarlyBlock(int64_t offset, int size)
+{
+  // copy the payload out of the ring space it was received into
+  byte *first, *second;
+  int firstLength, secondLength;
+  m_circularBuffer.WritableRegions(&first, &firstLength, &second, &secondLength);
+  std::vector<byte>& held = m_earlyBlocks[offset];
+  held.assign(first, first + std::min(size, firstLength));
+  if (size > firstLength)
+    held.insert(held.end(), second, second + (size - firstLength));
+  RingStats::Add(m_blocksHeld);
+  TRACE_BUFFER("Holding early block %llu, %d held", offset, (int )m_earlyBlocks.size());
+}
+
+uint32_t TimeshiftBuffer::TakeEarlyBlock(int64_t watchFor, uint64_t *block)
+{
+  if (m_earlyBlocks.empty())
+    return 0;
+
+  auto it = watchFor == -1 ? m_earlyBlocks.begin() : m_earlyBlocks.find(watchFor);
+  if (it == m_earlyBlocks.end())
+  {
+    // the block we wait for is not coming, carry on from the first one we have
+    if (m_seek.Active() || (int )m_earlyBlocks.size() < m_sd.windowSize)
+      return 0;
+    it = m_earlyBlocks.upper_bound(watchFor);
+    if (it == m_earlyBlocks.end())
+      return 0;
+    kodi::Log(ADDON_LOG_DEBUG, "%s:%d: gave up waiting for block %lld, continuing at %lld", __FUNCTION__, __LINE__, watchFor, it->first);
+  }
+
+  byte *first, *second;
+  int firstLength, secondLength;
+  const int size = static_cast<int>(it->second.size());
+  if (m_circularBuffer.WritableRegions(&first, &firstLength, &second, &secondLength) < size)
+    return 0;
+  memcpy(first, it->second.data(), std::min(size, firstLength));
+  if (size > firstLength)
+    memcpy(second, it->second.data() + firstLength, size - firstLength);
+
+  if (m_circularBuffer.BytesAvailable() == 0) // Buffer empty!
+    m_sd.streamPosition.store(it->first);
+  *block = it->first;
+  m_earlyBlocks.erase(m_earlyBlocks.begin(), ++it);
+  TRACE_BUFFER("Returning held block %llu for buffering", *block);
+  return size;
+}
+
+/* Publish 'size' bytes already received into the ring buffer.
+ */
+bool TimeshiftBuffer::CommitData(unsigned int size, uint64_t blockNum)
+{
+  byte *first, *second;
+  int firstLength, secondLength;
+  m_circularBuffer.WritableRegions(&first, &firstLength, &second, &secondLength);
+  firstLength = std::min((int )size, firstLength);
+  m_index.Feed(blockNum, first, firstLength);
+  if ((int )size > firstLength)
+    m_index.Feed(blockNum + firstLength, second, size - firstLength);
+  if (m_spill.IsOpen())
+    m_spill.Store(blockNum, first, firstLength, second, size - firstLength);
+  if (m_circularBuffer.CommitWrite(size))
+  {
+    m_sd.lastBlockBuffered = blockNum;
+    m_nextBlock = blockNum + m_sd.inputBlockSize;
+    return true;
+  }
+  kodi::Log(ADDON_LOG_ERROR, "%s:%d: Error committing block to circularBuffer!", __FUNCTION__, __LINE__);
+  return false;
+}
+
 /* Write data to ring buffer from buffer specified in 'buf'. Amount read in is
  * specified by 'size'.
  */
 bool TimeshiftBuffer::WriteData(const byte *buf, unsigned int size, uint64_t blockNum)
 {
-  std::unique_lock<std::mutex> lock(m_mutex);
   if (m_circularBuffer.WriteBytes(buf, size))
   {
     m_sd.lastBlockBuffered = blockNum;
@@ -451,102 +795,98 @@ bool TimeshiftBuffer::WriteData(const byte *buf, unsigned int size, uint64_t blo
   return false;
  }
 
- void TimeshiftBuffer::TSBTimerProc()
- {
-   // ONLY use atomic types/ops inR session_data, don't mess with
-   // the locks!
-   while (m_active)
-   {
-     std::this_thread::sleep_for(std::chrono::seconds(1));  // Let's try 1 per second.
-
-     // First, take a snapshot
-     time_t now = time(NULL);
-     time_t sessionStartTime = m_sd.sessionStartTime.load();
-     time_t tsbStartTime = m_sd.tsbStartTime.load();
-     int64_t lastKnownLength = m_sd.lastKnownLength.load();
-     uint64_t streamPosition = m_sd.streamPosition.load();
-     int64_t tsbStart = m_sd.tsbStart.load();
-     time_t iBytesPerSecond = m_sd.iBytesPerSecond;
-     bool isPaused = m_sd.isPaused;
-     time_t pauseStart = m_sd.pauseStart;
-     time_t lastPauseAdjust = m_sd.lastPauseAdjust;
-
-     if (tsbStartTime == 0)
-     {
-       tsbStartTime = sessionStartTime;
-     }
-
-     // Now perform the calculations
-     time_t elapsed = now - tsbStartTime;
-     //kodi::Log(ADDON_LOG_ERROR, "TSBTimerProc: time_diff: %d, tsbStartTime: %d", elapsed, tsbStartTime);
-     if (elapsed > m_settings.m_timeshiftBufferSeconds)
-     {
-       // Roll the tsb forward
-       int tsbRoll = elapsed - m_settings.m_timeshiftBufferSeconds;
-       elapsed = m_settings.m_timeshiftBufferSeconds;
-       tsbStart += (tsbRoll * iBytesPerSecond);
-       tsbStartTime += tsbRoll;
-       // kodi::Log(ADDON_LOG_ERROR, "startTime: %d, start: %lli, isPaused: %d, tsbRoll: %d", tsbStartTime, tsbStart, isPaused, tsbRoll);
-     }
-     if (m_sd.isPaused)
-     {
-       if ((now > pauseStart) && (now > lastPauseAdjust))
-       { // If we're paused, we stop requesting/receiving buffers, so lastKnownLength doesn't get updated. Fudge it here.
-         lastKnownLength += ((now - lastPauseAdjust) * iBytesPerSecond);
-         lastPauseAdjust = now;
-       }
-     }
-
-     int totalTime = now - sessionStartTime;                // total seconds we've been tuned to this channel.
-     iBytesPerSecond = totalTime ? (int )(lastKnownLength / totalTime) : 0;  // lastKnownLength (total bytes buffered) / number_of_seconds buffered.
-
-     // Write everything back
-     m_sd.tsbStartTime.store(tsbStartTime);
-     m_sd.tsbStart.store(tsbStart);
-     m_sd.lastKnownLength.store(lastKnownLength);
-     m_sd.iBytesPerSecond = iBytesPerSecond;
-     m_sd.ptsBegin.store((tsbStartTime - sessionStartTime) * STREAM_TIME_BASE);
-     m_sd.ptsEnd.store((now - sessionStartTime) * STREAM_TIME_BASE);
-     m_sd.lastPauseAdjust = lastPauseAdjust;
-
-
-//     kodi::Log(ADDON_LOG_ERROR, "tsb_start: %lli, end: %llu, B/sec: %d",
-//               tsbStart, lastKnownLength, iBytesPerSecond);
-
-   }
- }
+void TimeshiftBuffer::UpdateStreamTimes()
+{
+  std::unique_lock<std::mutex> lock(m_timesLock);
+  time_t now = time(NULL);
+  time_t sessionStartTime = m_sd.sessionStartTime.load();
+  time_t tsbStartTime = m_sd.tsbStartTime.load();
+  int64_t lastKnownLength = m_sd.lastKnownLength.load();
+  int64_t tsbStart = m_sd.tsbStart.load();
+  time_t lastPauseAdjust = m_sd.lastPauseAdjust;
+
+  if (sessionStartTime == 0)
+    return;
+  if (tsbStartTime == 0)
+    tsbStartTime = sessionStartTime;
+
+  // until the estimate settles, average over the whole session
+  int iBytesPerSecond = m_bitrate.BytesPerSecond();
+  if (iBytesPerSecond == 0)
+  {
+    int totalTime = now - sessionStartTime;
+    iBytesPerSecond = totalTime ? (int )(lastKnownLength / totalTime) : 0;
+  }
+
+  time_t elapsed = now - tsbStartTime;
+  if (elapsed > m_settings.m_timeshiftBufferSeconds)
+  {
+    // Roll the tsb forward
+    int tsbRoll = elapsed - m_settings.m_timeshiftBufferSeconds;
+    tsbStart += (static_cast<int64_t>(tsbRoll) * iBytesPerSecond);
+    tsbStartTime += tsbRoll;
+    int64_t indexed = m_index.OffsetAt(static_cast<double>(tsbStartTime - sessionStartTime));
+    if (indexed >= 0)
+    {
+      tsbStart = indexed;
+      m_index.Trim(tsbStart);
+    }
+  }
+  if (m_sd.isPaused)
+  {
+    if ((now > m_sd.pauseStart) && (now > lastPauseAdjust))
+    { // If we're paused, we stop requesting/receiving buffers, so lastKnownLength doesn't get updated. Fudge it here.
+      lastKnownLength += ((now - lastPauseAdjust) * iBytesPerSecond);
+      lastPauseAdjust = now;
+    }
+  }
+
+  // Write back whatever moved
+  if (tsbStartTime != m_sd.tsbStartTime.load())
+  {
+    m_sd.tsbStartTime.store(tsbStartTime);
+    m_sd.tsbStart.store(tsbStart);
+  }
+  if (lastPauseAdjust != m_sd.lastPauseAdjust)
+  {
+    m_sd.lastKnownLength.store(lastKnownLength);
+    m_sd.lastPauseAdjust = lastPauseAdjust;
+  }
+  m_sd.iBytesPerSecond.store(iBytesPerSecond);
+  m_sd.ptsBegin.store((tsbStartTime - sessionStartTime) * STREAM_TIME_BASE);
+  m_sd.ptsEnd.store((now - sessionStartTime) * STREAM_TIME_BASE);
+}
 
 void TimeshiftBuffer::ConsumeInput()
 {
   kodi::Log(ADDON_LOG_DEBUG, "TimeshiftBuffer::ConsumeInput()");
-  byte *buffer = new byte[INPUT_READ_LENGTH];
+  const int blockSize = m_sd.inputBlockSize;
 
-  while (m_active)
+  while (m_active && !m_ended.load())
   {
-    memset(buffer, 0, INPUT_READ_LENGTH);
-
     RequestBlocks();
 
     uint32_t read;
     uint64_t blockNo;
-    while ((read = WatchForBlock(buffer, &blockNo)))
+    while ((read = WatchForBlock(&blockNo)))
     {
 //      kodi::Log(ADDON_LOG_DEBUG, "Processing %d byte block", read);
-      if (WriteData(buffer, read, blockNo))
+      if (CommitData(read, blockNo))
       {
-        std::unique_lock<std::mutex> lock(m_mutex);
-        //kodi::Log(ADDON_LOG_DEBUG, "Data Buffered");
-        //kodi::Log(ADDON_LOG_DEBUG, "Notifying reader");
-        // Signal that we have data again
-        if (m_seek.Active())
         {
-          if (m_seek.PostprocessSeek(blockNo))
+          std::unique_lock<std::mutex> lock(m_mutex);
+          //kodi::Log(ADDON_LOG_DEBUG, "Data Buffered");
+          if (m_seek.Active())
           {
-            kodi::Log(ADDON_LOG_DEBUG, "Notify Seek");
-            m_seeker.notify_one();
+            if (m_seek.PostprocessSeek(blockNo))
+            {
+              kodi::Log(ADDON_LOG_DEBUG, "Notify Seek");
+              m_seeker.notify_one();
+            }
           }
         }
-        m_reader.notify_one();
+        // Signal that we have data again
+        WakeReader();
       }
       else
       {
@@ -554,17 +894,31 @@ void TimeshiftBuffer::ConsumeInput()
       }
       std::this_thread::yield();
       std::unique_lock<std::mutex> lock(m_mutex);
-      if (m_circularBuffer.BytesFree() < INPUT_READ_LENGTH)
+      if (m_circularBuffer.BytesFree() < blockSize)
       {
-        m_writer.wait(lock, [this]()
+        m_writerWaiting.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        m_writer.wait(lock, [this, blockSize]()
         {
-          return (!m_active || (m_circularBuffer.BytesFree() >= INPUT_READ_LENGTH));
+          return (!m_active || (m_circularBuffer.BytesFree() >= blockSize));
         });
+        m_writerWaiting.store(false);
       }
-      if (!m_active || ((blockNo + INPUT_READ_LENGTH) == m_sd.requestBlock))
+      if (!m_active || ((blockNo + blockSize) == m_sd.requestBlock))
         break;
     }
   }
+
+  if (m_ended.load())
+  {
+    // nothing more is coming, let a waiting Read() drain the buffer and a waiting Seek() give up
+    kodi::Log(ADDON_LOG_DEBUG, "Streaming connection ended, stopping input");
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_reader.notify_all();
+    }
+    std::unique_lock<std::mutex> sLock(m_sLock);
+    m_seeker.notify_all();
+  }
   kodi::Log(ADDON_LOG_DEBUG, "CONSUMER THREAD IS EXITING!!!");
-  delete[] buffer;
 }
@@ -20,9 +20,16 @@
 #include <condition_variable>
 #include <mutex>
 #include <atomic>
+#include <map>
+#include <vector>
 #include "../Socket.h"
+#include "BitrateEstimator.h"
+#include "BufferTrace.h"
 #include "CircularBuffer.h"
+#include "LiveShiftParser.h"
+#include "PcrIndex.h"
 #include "Seeker.h"
+#include "SpillFile.h"
 #include "session.h"
 
 
@@ -84,8 +91,14 @@ namespace timeshift {
   private:
 
     const static int INPUT_READ_LENGTH;
+    const static int MAX_READ_LENGTH;
     const static int WINDOW_SIZE;
+    const static int MIN_WINDOW_SIZE;
     const static int BUFFER_BLOCKS;
+    const static int BLOCKS_PER_SECOND;
+    const static int BUFFER_SECONDS;
+    const static int REQUEST_LENGTH;
+    const static int POLL_INTERVAL;
 
     NextPVR::Socket           *m_streamingclient;
 
@@ -95,11 +108,36 @@ namespace timeshift {
      */
     void ConsumeInput();
 
-    void TSBTimerProc();
-
+    /**
+     * Brings the timeshift window, the stream times and the paused length up
+     * to date. Called when they are asked for rather than on a timer.
+     */
+    void UpdateStreamTimes();
 
     bool WriteData(const byte *, unsigned int, uint64_t);
 
+    /**
+     * Publish a block WatchForBlock() received straight into the circular buffer
+     */
+    bool CommitData(unsigned int, uint64_t);
+
+    /**
+     * Sizes the blocks, ring and request window for this session from the
+     * last bitrate seen on the channel and the connection round trip time.
+     */
+    void SetGeometry();
+
+    /**
+     * Number of requests to keep in flight for the given bitrate
+     */
+    int WindowSize(int bytesPerSecond) const;
+
+    /**
+     * Wake the other side of the circular buffer if it is parked waiting on us.
+     */
+    void WakeReader();
+    void WakeWriter();
+
     /**
      * Closes any open file handles and resets all file positions
      */
@@ -112,9 +150,17 @@ namespace timeshift {
     void internalRequestBlocks(void);  // Call when already holding lock.
 
     /**
-     * Pull in incoming blocks.
+     * Pull in incoming blocks. The payload is received into the free space of
+     * the circular buffer and only kept if CommitData() is called for it.
      */
-    uint32_t WatchForBlock(byte *, uint64_t *);
+    uint32_t WatchForBlock(uint64_t *);
+
+    /**
+     * Blocks that arrive ahead of the one we are waiting for are copied into
+     * m_earlyBlocks, and put in the circular buffer once it is their turn.
+     */
+    void HoldEarlyBlock(int64_t offset, int size);
+    uint32_t TakeEarlyBlock(int64_t watchFor, uint64_t *block);
 
     /**
      * The thread that reads from m_inputHandle and writes to the output
@@ -123,10 +169,14 @@ namespace timeshift {
     std::thread m_inputThread;
 
     /**
-     * The thread that keeps track of the size of the current tsb, and
-     * drags the starting time forward when slip seconds is exceeded
+     * Stream bitrate, fed by the file length in each block header
      */
-    std::thread m_tsbThread;
+    BitrateEstimator m_bitrate;
+
+    /**
+     * Serialises UpdateStreamTimes() between the Kodi threads calling it
+     */
+    std::mutex m_timesLock;
 
     /**
      * Protects m_output*Handle
@@ -148,6 +198,36 @@ namespace timeshift {
      */
     mutable std::condition_variable m_writer;
 
+    /**
+     * Set while Read() or ConsumeInput() is parked on m_reader / m_writer, the
+     * other side only takes m_mutex to notify when these are set.
+     */
+    std::atomic<bool> m_readerWaiting;
+    std::atomic<bool> m_writerWaiting;
+
+    /**
+     * Set by the input thread when the streaming connection closed or lost
+     * its framing. The input thread stops and Read() reports end of stream
+     * once the buffer is drained.
+     */
+    std::atomic<bool> m_ended;
+
+    /**
+     * Set by Seek() when the buffer was emptied to receive the seek block,
+     * Read() moves to the seek position before reading and clears it.
+     */
+    std::atomic<bool> m_seekPending;
+
+    /**
+     * Session counters, logged on Close()
+     */
+    std::atomic<uint64_t> m_blocksRequested{0};
+    std::atomic<uint64_t> m_blocksReceived{0};
+    std::atomic<uint64_t> m_underflows{0};
+    std::atomic<uint64_t> m_blocksHeld{0};
+    std::atomic<uint64_t> m_blocksSpilled{0};
+    LatencyHistogram m_blockWait;
+
     /**
      * Signaled whenever seek processing is complete.
      */
@@ -157,6 +237,39 @@ namespace timeshift {
      * The current write position in the buffer file
      */
     Seeker m_seek;
+
+    /**
+     * Time taken to connect to the backend, in milliseconds
+     */
+    int m_rtt;
+
+    /**
+     * Framing of the block stream, and whether the payload of the current
+     * block is being received into m_circularBuffer
+     */
+    LiveShiftParser m_parser;
+    bool m_blockInRing;
+
+    /**
+     * Reassembly of out of order blocks, keyed by stream offset. Protected by m_mutex.
+     */
+    std::map<int64_t, std::vector<byte>> m_earlyBlocks;
+
+    /**
+     * Offset of the block that follows the last one buffered, -1 when any will do
+     */
+    int64_t m_nextBlock;
+
+    /**
+     * Optional local copy of every block received, so seeks into the part
+     * already watched do not go back to the backend
+     */
+    SpillFile m_spill;
+
+    /**
+     * PCR times of the blocks buffered, for the window start and seek limits
+     */
+    PcrIndex m_index;
     CircularBuffer m_circularBuffer;
     session_data_t m_sd;
     bool m_CanPause;
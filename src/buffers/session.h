@@ -24,12 +24,16 @@ namespace timeshift {
      * Sliding window variable, should be in range 0..WINDOW_SIZE
      */
     int currentWindowSize;
+    /**
+     * Upper end of currentWindowSize, follows the bitrate during the session
+     */
+    int windowSize;
     /**
      * Requests sent to back end this session.
      */
     int requestNumber;
     /**
-     *
+     * Size of each block requested from the back end, fixed for the session
      */
     int inputBlockSize;
     
@@ -49,7 +53,10 @@ namespace timeshift {
     
     volatile std::atomic<int64_t> tsbStart;
     
-    volatile int iBytesPerSecond;
+    /**
+     * Stream bitrate, only written by UpdateStreamTimes()
+     */
+    std::atomic<int> iBytesPerSecond;
     volatile std::atomic<time_t> sessionStartTime;
     volatile std::atomic<time_t> tsbStartTime;
     volatile time_t tsbRollOff;
@@ -9,9 +9,12 @@
 #pragma once
 
 #include <algorithm>
+#include <charconv>
 #include <cstdint>
+#include <ctime>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <tinyxml2.h>
 #include <vector>
 
@@ -161,6 +164,66 @@ inline bool GetLong(const tinyxml2::XMLNode* pRootNode, const std::string& strTa
   return true;
 }
 
+/* \brief To get a text string value stored inside XML without copying it.
+
+   \param[in] pRootNode TinyXML related node field
+   \param[in] strTag XML identification tag
+   \param[out] value View of the text, valid for the lifetime of the XML document
+   \return true if available and successfully done
+*/
+inline bool GetStringView(const tinyxml2::XMLNode* pRootNode, const char* strTag, std::string_view& value)
+{
+  const tinyxml2::XMLElement* pElement = pRootNode->FirstChildElement(strTag);
+  if (!pElement)
+    return false;
+  const tinyxml2::XMLNode* pNode = pElement->FirstChild();
+  if (pNode != nullptr)
+  {
+    value = pNode->Value();
+    return true;
+  }
+  value = std::string_view();
+  return false;
+}
+
+/* \brief To get a 64 bit integer value stored inside XML without copying the text.
+
+   \param[in] pRootNode TinyXML related node field
+   \param[in] strTag XML identification tag
+   \param[out] value The read value from XML
+   \return true if available and successfully done
+*/
+inline bool GetInt64(const tinyxml2::XMLNode* pRootNode, const char* strTag, int64_t& value)
+{
+  std::string_view text;
+  if (!GetStringView(pRootNode, strTag, text))
+    return false;
+  while (!text.empty() && isspace(static_cast<unsigned char>(text.front())))
+    text.remove_prefix(1);
+  return std::from_chars(text.data(), text.data() + text.size(), value).ec == std::errc();
+}
+
+/* \brief To get a time stored inside XML as epoch milliseconds, returned in seconds.
+
+   NextPVR sends times as 13 digit millisecond ticks, only the first 10 digits are read.
+
+   \param[in] pRootNode TinyXML related node field
+   \param[in] strTag XML identification tag
+   \param[out] value The read value from XML
+   \return true if available and successfully done
+*/
+inline bool GetEpochSeconds(const tinyxml2::XMLNode* pRootNode, const char* strTag, time_t& value)
+{
+  std::string_view text;
+  if (!GetStringView(pRootNode, strTag, text))
+    return false;
+  int64_t seconds;
+  if (std::from_chars(text.data(), text.data() + std::min<size_t>(text.size(), 10), seconds).ec != std::errc())
+    return false;
+  value = static_cast<time_t>(seconds);
+  return true;
+}
+
 /* \brief To get a boolean value stored inside XML.
    \param[in] pRootNode TinyXML related node field
    \param[in] strTag XML identification tag